@@ -6,24 +6,63 @@
 
 static int temp_cnt = 0;
 static int label_cnt = 0;
+static decl_t* cur_program = NULL;  // For typedef and global lookups during lowering
+static int operands_swapped = 0;  // For --stats
 
 static void lower_stmt(stmt_t* s, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail);
 static char* lower_expr(expr_t* e, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail);
+static char* lower_addr(expr_t* e, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail);
+static char* lower_addr_mode(expr_t* e, int* offset, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail);
+static void lower_branch(expr_t* e, char* label, int jump_if, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail);
 
 
-static ir_instr_t* new_ir(ir_op_t op, char* dest, char* src1, char* src2, int imm) {
-    ir_instr_t* i = malloc(sizeof(ir_instr_t));
+// Interned operand names: every occurrence of a name within one function shares one arena string
+char* ir_intern(ir_func_t* f, const char* name) {
+    if (!name) return NULL;
+
+    if (f->names_count * 2 >= f->names_cap) {  // Keep the table at most half full
+        int cap = f->names_cap ? f->names_cap * 2 : 64;
+        char** names = arena_alloc(f->arena, cap * sizeof(char*));
+        for (int k = 0; k < f->names_cap; k++) {
+            char* old = f->names[k];
+            if (!old) continue;
+            unsigned h = 5381;
+            for (const char* c = old; *c; c++) h = h * 33 + (unsigned char)*c;
+            int slot = h & (cap - 1);
+            while (names[slot]) slot = (slot + 1) & (cap - 1);
+            names[slot] = old;
+        }
+        f->names = names;  // The old table stays in the arena until the function is dropped
+        f->names_cap = cap;
+    }
+
+    unsigned h = 5381;
+    for (const char* c = name; *c; c++) h = h * 33 + (unsigned char)*c;
+    int slot = h & (f->names_cap - 1);
+    while (f->names[slot]) {
+        if (strcmp(f->names[slot], name) == 0) return f->names[slot];
+        slot = (slot + 1) & (f->names_cap - 1);
+    }
+    f->names[slot] = arena_strdup(f->arena, name);
+    f->names_count++;
+    return f->names[slot];
+}
+
+
+ir_instr_t* new_ir(ir_func_t* func, ir_op_t op, char* dest, char* src1, char* src2, int imm) {
+    ir_instr_t* i = arena_alloc(func->arena, sizeof(ir_instr_t));
     i->op = op;
-    i->dest = dest ? strdup(dest) : NULL;
-    i->src1 = src1 ? strdup(src1) : NULL;
-    i->src2 = src2 ? strdup(src2) : NULL;
+    i->dest = ir_intern(func, dest);
+    i->src1 = ir_intern(func, src1);
+    i->src2 = ir_intern(func, src2);
     i->imm = imm;
+    i->mem = NULL;
     i->next = NULL;
     return i;
 }
 
 
-static void append_ir(ir_instr_t** first, ir_instr_t** tail, ir_instr_t* instr) {
+void append_ir(ir_instr_t** first, ir_instr_t** tail, ir_instr_t* instr) {
     if (*tail) {
         (*tail)->next = instr;
     } else {
@@ -33,17 +72,383 @@ static void append_ir(ir_instr_t** first, ir_instr_t** tail, ir_instr_t* instr)
 }
 
 
-static char* new_temp(void) {
+char* new_temp(ir_func_t* func) {
     char buf[16];
     snprintf(buf, sizeof(buf), "t%d", temp_cnt++);
-    return strdup(buf);
+    return ir_intern(func, buf);
 }
 
 
-static char* new_label(void) {
+char* new_label(ir_func_t* func) {
     char buf[16];
     snprintf(buf, sizeof(buf), "L%d", label_cnt++);
-    return strdup(buf);
+    return ir_intern(func, buf);
+}
+
+
+type_t* ir_resolve_type(type_t* t) {
+    while (t && t->kind == TYPE_NAMED) {
+        decl_t* d = cur_program;
+        while (d && !(d->kind == DECL_TYPE && strcmp(d->name, t->name) == 0)) d = d->next;
+        if (!d) return t;  // Semantic analysis already reported unknown names
+        t = d->type;
+    }
+    return t;
+}
+
+
+int ir_type_size(type_t* t) {
+    t = ir_resolve_type(t);
+    if (!t) return 0;
+
+    switch (t->kind) {
+        case TYPE_ARRAY: return t->size * ir_type_size(t->subtype);
+        case TYPE_STRUCT: {
+            int size = 0;
+            for (param_t* fld = t->params; fld; fld = fld->next) size += ir_type_size(fld->type);
+            return size;
+        }
+        default: return 4;  // int, bool, char, uint and pointers are all one word
+    }
+}
+
+
+ir_var_t* ir_find_var(ir_func_t* f, const char* name) {
+    for (ir_var_t* v = f->vars; v; v = v->next) {
+        if (strcmp(v->name, name) == 0) return v;
+    }
+    return NULL;
+}
+
+
+static void add_var(ir_func_t* f, ir_var_t*** tail, char* name, type_t* type, int param_index) {
+    ir_var_t* v = arena_alloc(f->arena, sizeof(ir_var_t));
+    v->name = ir_intern(f, name);
+    v->type = ir_resolve_type(type);
+    v->size = ir_type_size(type);
+    v->is_param = param_index >= 0;
+    v->param_index = param_index;
+    v->offset = -1;
+    **tail = v;
+    *tail = &v->next;
+}
+
+
+static void collect_locals(ir_func_t* f, ir_var_t*** tail, stmt_t* s) {
+    for (stmt_t* cur = s; cur; cur = cur->next_stmt) {
+        switch (cur->kind) {
+            case STMT_DECL: add_var(f, tail, cur->decl->name, cur->decl->type, -1); break;
+            case STMT_IF:
+                collect_locals(f, tail, cur->body);
+                collect_locals(f, tail, cur->else_body);
+                break;
+            case STMT_WHILE:
+            case STMT_BLOCK: collect_locals(f, tail, cur->body); break;
+            default: break;
+        }
+    }
+}
+
+
+static type_t* lvalue_type(expr_t* e, ir_func_t* func);
+
+
+// Declaration of the struct field a field access names
+static param_t* field_decl(expr_t* e, ir_func_t* func) {
+    type_t* st = lvalue_type(e->left, func);
+    if (!st || st->kind != TYPE_STRUCT) return NULL;
+    for (param_t* fld = st->params; fld; fld = fld->next) {
+        if (strcmp(fld->name, e->name) == 0) return fld;
+    }
+    return NULL;
+}
+
+
+// Type of an lvalue-shaped expression (ID, field, index, deref), typedefs resolved
+static type_t* lvalue_type(expr_t* e, ir_func_t* func) {
+    switch (e->kind) {
+        case EXPR_ID: {
+            ir_var_t* v = ir_find_var(func, e->name);
+            if (v) return v->type;
+            for (decl_t* d = cur_program; d; d = d->next) {
+                if (d->kind == DECL_VAR && strcmp(d->name, e->name) == 0) return ir_resolve_type(d->type);
+            }
+            return NULL;
+        }
+        case EXPR_FIELD: {
+            param_t* fld = field_decl(e, func);
+            return fld ? ir_resolve_type(fld->type) : NULL;
+        }
+        case EXPR_INDEX:
+        case EXPR_DEREF: {
+            type_t* t = lvalue_type(e->left, func);
+            return t ? ir_resolve_type(t->subtype) : NULL;
+        }
+        default: return NULL;
+    }
+}
+
+
+// Alias class of the word an lvalue names, for the load or store that accesses it (NULL if unknown)
+static const mem_tag_t* lvalue_tag(expr_t* e, ir_func_t* func) {
+    type_t* t = lvalue_type(e, func);
+    if (!t || t->kind == TYPE_STRUCT || t->kind == TYPE_ARRAY) return NULL;  // Not a single word
+    mem_tag_t* tag = arena_alloc(func->arena, sizeof(mem_tag_t));
+    tag->type = t->kind;
+    tag->key = NULL;
+    switch (e->kind) {
+        case EXPR_ID:
+            tag->kind = MEM_VAR;
+            tag->key = ir_intern(func, e->name);
+            break;
+        case EXPR_FIELD:
+            tag->kind = MEM_FIELD;
+            tag->key = field_decl(e, func);
+            break;
+        case EXPR_INDEX: tag->kind = MEM_ELEM; break;
+        default: tag->kind = MEM_DEREF; break;
+    }
+    return tag;
+}
+
+
+// Whether arithmetic on e is unsigned (operands of a binary operator share their type)
+static int expr_is_unsigned(expr_t* e, ir_func_t* func) {
+    switch (e->kind) {
+        case EXPR_ID:
+        case EXPR_FIELD:
+        case EXPR_INDEX:
+        case EXPR_DEREF: {
+            type_t* t = lvalue_type(e, func);
+            return t && t->kind == TYPE_UINT;
+        }
+        case EXPR_ADD:
+        case EXPR_SUB:
+        case EXPR_MUL:
+        case EXPR_DIV:
+        case EXPR_NEG:
+            return expr_is_unsigned(e->left, func);
+        case EXPR_CALL: {
+            for (decl_t* d = cur_program; d; d = d->next) {
+                if (d->kind != DECL_FUNC || strcmp(d->name, e->name) != 0) continue;
+                type_t* t = ir_resolve_type(d->type->subtype);
+                return t && t->kind == TYPE_UINT;
+            }
+            return 0;
+        }
+        default: return 0;
+    }
+}
+
+
+// slt or sltu, after the signedness of the compared operands
+static ir_op_t slt_op(expr_t* cmp, ir_func_t* func) {
+    return expr_is_unsigned(cmp->left, func) ? IR_SLTU : IR_SLT;
+}
+
+
+static int field_offset(type_t* st, const char* name) {
+    int offset = 0;
+    for (param_t* fld = st ? st->params : NULL; fld; fld = fld->next) {
+        if (strcmp(fld->name, name) == 0) return offset;
+        offset += ir_type_size(fld->type);
+    }
+    return 0;
+}
+
+
+// Instruction selection. Each binary node is covered either by its register tile (both operands in
+// registers, R-type) or, when one operand is a literal, by an immediate tile that folds the literal
+// into an I-type instruction; the cheaper one is emitted. Operand subtrees other than the literal are
+// lowered the same way under both tiles, so only the instructions a tile emits and the cost of putting
+// its literal in a register are compared
+
+// Cost of an op on the Paul MIPS: every hardware instruction takes one cycle. mul/div have no hardware
+// support and run a shift-and-add routine of a few instructions per bit
+static int op_cost(ir_op_t op) {
+    switch (op) {
+        case IR_MUL:
+        case IR_DIV:
+        case IR_DIVU: return 4 * 32;
+        case IR_LABEL:
+        case IR_PHI: return 0;
+        default: return 1;
+    }
+}
+
+
+static int fits_simm16(long long v) {
+    return v >= -32768 && v <= 32767;
+}
+
+
+// Instructions needed to put constant v in a register
+static int const_cost(int v) {
+    if (v == 0) return 0;  // $zero
+    if (fits_simm16(v) || (v & 0xFFFF) == 0) return op_cost(IR_LI);  // addi or lui alone
+    return 2 * op_cost(IR_LI);  // lui + ori
+}
+
+
+// Value of a literal operand: numbers, chars, bools, null, and negated, added or subtracted literals
+// (C0 spells -3 as (0 - 3))
+static int const_value(expr_t* e, int* v) {
+    int l;
+    int r;
+    switch (e->kind) {
+        case EXPR_NUM: *v = e->num_val; return 1;
+        case EXPR_CHAR: *v = (int)e->char_val; return 1;
+        case EXPR_BOOL: *v = e->bool_val ? 1 : 0; return 1;
+        case EXPR_NULL: *v = 0; return 1;
+        case EXPR_NEG:
+            if (!const_value(e->left, v)) return 0;
+            *v = (int)(0u - (unsigned)*v);
+            return 1;
+        case EXPR_ADD:
+        case EXPR_SUB:
+            if (!const_value(e->left, &l) || !const_value(e->right, &r)) return 0;
+            *v = (int)(e->kind == EXPR_ADD ? (unsigned)l + (unsigned)r : (unsigned)l - (unsigned)r);
+            return 1;
+        default: return 0;
+    }
+}
+
+
+// A literal in a register: $zero for 0, li otherwise
+static char* lower_const(int v, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    if (v == 0) return ir_intern(func, "$zero");
+    char* t = new_temp(func);
+    append_ir(first, tail, new_ir(func, IR_LI, t, NULL, NULL, v));  // Uses LUI/ORI if >16-bit
+    return t;
+}
+
+
+// Register tile: what lower_expr emits for the node itself plus loading each literal operand
+static int reg_tile_cost(expr_t* e) {
+    int cost;
+    switch (e->kind) {
+        case EXPR_MUL:
+        case EXPR_DIV: cost = op_cost(IR_MUL); break;
+        case EXPR_EQ:
+        case EXPR_NEQ:
+        case EXPR_LEQ:
+        case EXPR_GEQ: cost = 2 * op_cost(IR_SLT); break;  // sub + sltiu/sltu, slt + xori
+        default: cost = op_cost(IR_ADD); break;
+    }
+    int v;
+    if (const_value(e->left, &v)) cost += const_cost(v);
+    if (const_value(e->right, &v)) cost += const_cost(v);
+    return cost;
+}
+
+
+// Immediate tile for a binary node with a literal operand: x op imm, negated with xori when negate is set
+typedef struct {
+    expr_t* x;  // The operand left in a register
+    int imm;
+    int negate;
+    int cost;
+} imm_tile_t;
+
+
+// Comparison against a literal as x < k (slti/sltiu), negated if needed: x <= c is x < c + 1, x >= c
+// is !(x < c) and literals on the left mirror the comparison
+static int match_slt_imm(expr_t* e, int is_unsigned, imm_tile_t* t) {
+    int c;
+    int lit_left = const_value(e->left, &c);
+    if (!lit_left && !const_value(e->right, &c)) return 0;
+    expr_kind_t k = e->kind;
+    if (lit_left) {
+        k = k == EXPR_LT ? EXPR_GT : k == EXPR_GT ? EXPR_LT : k == EXPR_LEQ ? EXPR_GEQ : EXPR_LEQ;
+        t->x = e->right;
+    } else t->x = e->left;
+    long long bound = (long long)c + ((k == EXPR_GT || k == EXPR_LEQ) ? 1 : 0);
+    t->negate = k == EXPR_GT || k == EXPR_GEQ;
+    if (is_unsigned ? (bound < 0 || bound > 32767) : !fits_simm16(bound)) return 0;
+    t->imm = (int)bound;
+    t->cost = op_cost(IR_SLTI) + (t->negate ? op_cost(IR_XORI) : 0);
+    return 1;
+}
+
+
+static int match_imm_tile(expr_t* e, ir_func_t* func, imm_tile_t* t) {
+    int c;
+    int lit_left = const_value(e->left, &c);
+    if (!lit_left && !const_value(e->right, &c)) return 0;
+    t->x = lit_left ? e->right : e->left;
+    t->negate = 0;
+    switch (e->kind) {
+        case EXPR_ADD:  // addi x, c
+            if (!fits_simm16(c)) return 0;
+            t->imm = c;
+            t->cost = op_cost(IR_ADDI);
+            return 1;
+        case EXPR_SUB:  // x - c is addi x, -c
+            if (lit_left || !fits_simm16(-(long long)c)) return 0;
+            t->imm = -c;
+            t->cost = op_cost(IR_ADDI);
+            return 1;
+        case EXPR_MUL: {  // x * 2^k is k doublings
+            if (c <= 0 || (c & (c - 1)) != 0) return 0;
+            int k = 0;
+            while ((1 << k) != c) k++;
+            t->imm = k;
+            t->cost = k * op_cost(IR_ADD);
+            return 1;
+        }
+        case EXPR_EQ:
+        case EXPR_NEQ:  // addi x, -c then the test against zero (no addi when c is 0)
+            if (!fits_simm16(-(long long)c)) return 0;
+            t->imm = -c;
+            t->cost = (c ? op_cost(IR_ADDI) : 0) + op_cost(IR_SLTIU);
+            return 1;
+        case EXPR_LT:
+        case EXPR_GT:
+        case EXPR_LEQ:
+        case EXPR_GEQ:
+            return match_slt_imm(e, expr_is_unsigned(e->left, func), t);
+        default: return 0;
+    }
+}
+
+
+static char* emit_imm_tile(expr_t* e, imm_tile_t* tile, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    char* x = lower_expr(tile->x, func, first, tail);
+    switch (e->kind) {
+        case EXPR_MUL: {
+            for (int k = 0; k < tile->imm; k++) {
+                char* doubled = new_temp(func);
+                append_ir(first, tail, new_ir(func, IR_ADD, doubled, x, x, 0));  // *2
+                x = doubled;
+            }
+            return x;
+        }
+        case EXPR_EQ:
+        case EXPR_NEQ: {
+            char* t = new_temp(func);
+            if (tile->imm) {
+                append_ir(first, tail, new_ir(func, IR_ADDI, t, x, NULL, tile->imm));  // diff = x - c
+                x = t;
+            }
+            if (e->kind == EXPR_EQ) append_ir(first, tail, new_ir(func, IR_SLTIU, t, x, NULL, 1));  // diff == 0
+            else append_ir(first, tail, new_ir(func, IR_SLTU, t, "$zero", x, 0));  // diff != 0
+            return t;
+        }
+        case EXPR_LT:
+        case EXPR_GT:
+        case EXPR_LEQ:
+        case EXPR_GEQ: {
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, slt_op(e, func) == IR_SLTU ? IR_SLTIU : IR_SLTI, t, x, NULL, tile->imm));
+            if (tile->negate) append_ir(first, tail, new_ir(func, IR_XORI, t, t, NULL, 1));
+            return t;
+        }
+        default: {  // ADD, SUB
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_ADDI, t, x, NULL, tile->imm));
+            return t;
+        }
+    }
 }
 
 
@@ -51,6 +456,7 @@ static char* new_label(void) {
 ir_program_t* lower_to_ir(decl_t* program_ast) {
     ir_program_t* ir = calloc(1, sizeof(ir_program_t));
     ir->globals = program_ast;
+    cur_program = program_ast;
 
     ir_func_t** func_tail = &ir->functions;
 
@@ -58,18 +464,23 @@ ir_program_t* lower_to_ir(decl_t* program_ast) {
         if (d->kind != DECL_FUNC) continue;
 
         ir_func_t* f = calloc(1, sizeof(ir_func_t));
-        f->name = strdup(d->name);
+        f->arena = arena_create();
+        f->name = arena_strdup(f->arena, d->name);
         f->ret_type = d->type->subtype;
         f->params = d->type->params;
         f->ast = d;
 
+        ir_var_t** var_tail = &f->vars;
+        int index = 0;
+        for (param_t* p = f->params; p; p = p->next) add_var(f, &var_tail, p->name, p->type, index++);
+        collect_locals(f, &var_tail, d->code);
+
         ir_instr_t* body_head = NULL;
         ir_instr_t* body_tail = NULL;
         lower_stmt(d->code, f, &body_head, &body_tail);
+        append_ir(&body_head, &body_tail, new_ir(f, IR_JR, NULL, "$ra", NULL, 0));
         f->body = body_head;
 
-        append_ir(&body_head, &body_tail, new_ir(IR_JR, NULL, "$ra", NULL, 0));
-
         *func_tail = f;
         func_tail = &f->next;
     }
@@ -86,47 +497,53 @@ static void lower_stmt(stmt_t* s, ir_func_t* func, ir_instr_t** first, ir_instr_
                 // Local variable declaration - nothing to emit unless init
                 if (cur->decl->value) {
                     char* val = lower_expr(cur->decl->value, func, first, tail);
-                    append_ir(first, tail, new_ir(IR_MOVE, cur->decl->name, val, NULL, 0));
+                    char* addr = new_temp(func);
+                    append_ir(first, tail, new_ir(func, IR_LA, addr, cur->decl->name, NULL, 0));
+                    ir_instr_t* init = new_ir(func, IR_SW, val, addr, NULL, 0);
+                    expr_t var = { .kind = EXPR_ID, .name = cur->decl->name };
+                    init->mem = lvalue_tag(&var, func);
+                    append_ir(first, tail, init);
                 }
                 break;
             }
             case STMT_ASSIGN: {
                 char* rhs = lower_expr(cur->cond, func, first, tail);  // rhs value
-                char* lhs_addr = lower_expr(cur->init, func, first, tail);  // lvalue address
-                append_ir(first, tail, new_ir(IR_SW, rhs, lhs_addr, NULL, 0));
+                int offset;
+                char* lhs_base = lower_addr_mode(cur->init, &offset, func, first, tail);  // lvalue address
+                ir_instr_t* store = new_ir(func, IR_SW, rhs, lhs_base, NULL, offset);
+                store->mem = lvalue_tag(cur->init, func);
+                append_ir(first, tail, store);
                 break;
             }
             case STMT_RETURN: {
                 if (cur->cond) {
                     char* val = lower_expr(cur->cond, func, first, tail);
-                    append_ir(first, tail, new_ir(IR_MOVE, "$v0", val, NULL, 0));
+                    append_ir(first, tail, new_ir(func, IR_MOVE, "$v0", val, NULL, 0));
                 }
-                append_ir(first, tail, new_ir(IR_JR, NULL, "$ra", NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_JR, NULL, "$ra", NULL, 0));
                 break;
             }
             case STMT_IF: {
-                char* cond = lower_expr(cur->cond, func, first, tail);
-                char* else_l = new_label();
-                char* end_l  = new_label();
+                char* else_l = new_label(func);
+                char* end_l  = new_label(func);
 
-                append_ir(first, tail, new_ir(IR_BEQ, cond, "$zero", else_l, 0));
+                lower_branch(cur->cond, else_l, 0, func, first, tail);
                 lower_stmt(cur->body, func, first, tail);
-                append_ir(first, tail, new_ir(IR_J, end_l, NULL, NULL, 0));
-                append_ir(first, tail, new_ir(IR_LABEL, else_l, NULL, NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_J, end_l, NULL, NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_LABEL, else_l, NULL, NULL, 0));
                 if (cur->else_body) lower_stmt(cur->else_body, func, first, tail);
-                append_ir(first, tail, new_ir(IR_LABEL, end_l, NULL, NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_LABEL, end_l, NULL, NULL, 0));
                 break;
             }
             case STMT_WHILE: {
-                char* start = new_label();
-                char* end   = new_label();
+                char* start = new_label(func);
+                char* end   = new_label(func);
 
-                append_ir(first, tail, new_ir(IR_LABEL, start, NULL, NULL, 0));
-                char* cond = lower_expr(cur->cond, func, first, tail);
-                append_ir(first, tail, new_ir(IR_BEQ, cond, "$zero", end, 0));
+                append_ir(first, tail, new_ir(func, IR_LABEL, start, NULL, NULL, 0));
+                lower_branch(cur->cond, end, 0, func, first, tail);
                 lower_stmt(cur->body, func, first, tail);
-                append_ir(first, tail, new_ir(IR_J, start, NULL, NULL, 0));
-                append_ir(first, tail, new_ir(IR_LABEL, end, NULL, NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_J, start, NULL, NULL, 0));
+                append_ir(first, tail, new_ir(func, IR_LABEL, end, NULL, NULL, 0));
                 break;
             }
             case STMT_BLOCK: {
@@ -141,213 +558,576 @@ static void lower_stmt(stmt_t* s, ir_func_t* func, ir_instr_t** first, ir_instr_
 }
 
 
+// Sethi-Ullman (Ershov) labeling: registers e needs to be evaluated without spilling. A leaf takes one
+// ($zero for a literal 0 takes none); a binary node takes one more than its operands when they tie and
+// the larger of the two otherwise. Calls and allocations are impure: their operands keep source order
+static void label_expr(expr_t* e) {
+    if (e->regs >= 0) return;
+    int v;
+    e->pure = true;
+    if (const_value(e, &v)) {
+        e->regs = v != 0;
+        return;
+    }
+    if (e->kind == EXPR_CALL || e->kind == EXPR_ALLOC) {
+        for (expr_t* arg = e->kind == EXPR_CALL ? e->left : NULL; arg; arg = arg->next) label_expr(arg);
+        e->pure = false;
+        e->regs = 1;
+        return;
+    }
+    int l = 0;
+    int r = 0;
+    if (e->left) {
+        label_expr(e->left);
+        l = e->left->regs;
+        e->pure = e->left->pure;
+    }
+    if (e->right) {
+        label_expr(e->right);
+        r = e->right->regs;
+        e->pure = e->pure && e->right->pure;
+    }
+    e->regs = l == r ? l + 1 : (l > r ? l : r);
+}
+
+
+// Evaluate the operand pair a, b into l, r. When neither has side effects the one needing more registers
+// goes first, so only its result is held while the lighter one is evaluated
+static void lower_pair(expr_t* a, expr_t* b, char** l, char** r, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    label_expr(a);
+    label_expr(b);
+    if (a->pure && b->pure && b->regs > a->regs) {
+        operands_swapped++;
+        *r = lower_expr(b, func, first, tail);
+        *l = lower_expr(a, func, first, tail);
+        return;
+    }
+    *l = lower_expr(a, func, first, tail);
+    *r = lower_expr(b, func, first, tail);
+}
+
+
 // Lower expression - returns name of temp holding result
 static char* lower_expr(expr_t* e, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
     if (!e) return NULL;
 
+    int v;
+    if (const_value(e, &v)) return lower_const(v, func, first, tail);  // Null and false are 0 too
+    if (e->kind <= EXPR_GEQ && e->kind != EXPR_AND && e->kind != EXPR_OR) {
+        imm_tile_t tile;
+        if (match_imm_tile(e, func, &tile) && tile.cost <= reg_tile_cost(e)) return emit_imm_tile(e, &tile, func, first, tail);
+    }
+
     switch (e->kind) {
-        case EXPR_NUM: {
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LI, t, NULL, NULL, e->num_val));  // Uses LUI/ORI if >16-bit
-            return t;
-        }
-        case EXPR_CHAR: {
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LI, t, NULL, NULL, (int)e->char_val));
-            return t;
-        }
-        case EXPR_BOOL: {
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LI, t, NULL, NULL, e->bool_val ? 1 : 0));
-            return t;
-        }
-        case EXPR_NULL: {
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LI, t, NULL, NULL, 0));  // Null as 0
-            return t;
-        }
-        case EXPR_ID: {
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LA, t, e->name, NULL, 0));  // Load address if global/var
-            append_ir(first, tail, new_ir(IR_LW, t, t, NULL, 0));  // Then load value
+        case EXPR_ID:
+        case EXPR_FIELD:
+        case EXPR_INDEX:
+        case EXPR_DEREF: {
+            int offset;
+            char* base = lower_addr_mode(e, &offset, func, first, tail);
+            char* t = new_temp(func);
+            ir_instr_t* load = new_ir(func, IR_LW, t, base, NULL, offset);  // Then load value
+            load->mem = lvalue_tag(e, func);
+            append_ir(first, tail, load);
             return t;
         }
         case EXPR_CALL: {
-            // Params: push to stack or regs (simple: use SW to $sp offsets)
-            expr_t* arg = e->left;
-            int offset = 0;
-            while (arg) {
-                char* a = lower_expr(arg, func, first, tail);
-                append_ir(first, tail, new_ir(IR_SW, a, "$sp", NULL, offset));
-                offset -= 4;  // Stack grows down
-                arg = arg->next;
+            // All arguments are evaluated first so a call nested in a later one cannot clobber them
+            int nargs = 0;
+            for (expr_t* arg = e->left; arg; arg = arg->next) nargs++;
+            char** vals = malloc((nargs ? nargs : 1) * sizeof(char*));
+            int k = 0;
+            for (expr_t* arg = e->left; arg; arg = arg->next) vals[k++] = lower_expr(arg, func, first, tail);
+            for (k = NUM_ARG_REGS; k < nargs; k++) {  // Outgoing-argument area at the bottom of the frame
+                append_ir(first, tail, new_ir(func, IR_SW, vals[k], "$sp", NULL, 4 * (k - NUM_ARG_REGS)));
+            }
+            for (k = 0; k < nargs && k < NUM_ARG_REGS; k++) {
+                char reg[4] = {'$', 'a', (char)('0' + k), '\0'};
+                append_ir(first, tail, new_ir(func, IR_MOVE, reg, vals[k], NULL, 0));
             }
-            append_ir(first, tail, new_ir(IR_JAL, e->name, NULL, NULL, 0));
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_MOVE, t, "$v0", NULL, 0));  // Return in $v0
+            free(vals);
+            int stack_args = nargs > NUM_ARG_REGS ? nargs - NUM_ARG_REGS : 0;
+            append_ir(first, tail, new_ir(func, IR_JAL, e->name, NULL, NULL, stack_args));
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_MOVE, t, "$v0", NULL, 0));  // Return in $v0
             return t;
         }
         case EXPR_ADD: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_ADD, t, l, r, 0));  // or ADDU for unsigned
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_ADD, t, l, r, 0));  // or ADDU for unsigned
             return t;
         }
         case EXPR_SUB: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SUB, t, l, r, 0));  // or SUBU
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_SUB, t, l, r, 0));  // or SUBU
             return t;
         }
         case EXPR_MUL: {
-            // Placeholder: call Paul's mult routine (e.g., JAL "mult")
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            append_ir(first, tail, new_ir(IR_MOVE, "$a0", l, NULL, 0));
-            append_ir(first, tail, new_ir(IR_MOVE, "$a1", r, NULL, 0));
-            append_ir(first, tail, new_ir(IR_JAL, "mult", NULL, NULL, 0));  // Assume mult func
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_MOVE, t, "$v0", NULL, 0));
+            // No hardware multiply: stays a pseudo-op until strength reduction or the mult routine takes it
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_MUL, t, l, r, 0));
             return t;
         }
         case EXPR_DIV: {
-            // Placeholder: call Paul's div routine
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            append_ir(first, tail, new_ir(IR_MOVE, "$a0", l, NULL, 0));
-            append_ir(first, tail, new_ir(IR_MOVE, "$a1", r, NULL, 0));
-            append_ir(first, tail, new_ir(IR_JAL, "div", NULL, NULL, 0));
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_MOVE, t, "$v0", NULL, 0));
-            return t;
-        }
-        case EXPR_AND: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_AND, t, l, r, 0));
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, expr_is_unsigned(e, func) ? IR_DIVU : IR_DIV, t, l, r, 0));
             return t;
         }
+        case EXPR_AND:
         case EXPR_OR: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_OR, t, l, r, 0));
+            // Short-circuit: the value only exists as control flow until it has to be stored
+            char* t = new_temp(func);
+            char* false_l = new_label(func);
+            char* end_l = new_label(func);
+            lower_branch(e, false_l, 0, func, first, tail);
+            append_ir(first, tail, new_ir(func, IR_LI, t, NULL, NULL, 1));
+            append_ir(first, tail, new_ir(func, IR_J, end_l, NULL, NULL, 0));
+            append_ir(first, tail, new_ir(func, IR_LABEL, false_l, NULL, NULL, 0));
+            append_ir(first, tail, new_ir(func, IR_LI, t, NULL, NULL, 0));
+            append_ir(first, tail, new_ir(func, IR_LABEL, end_l, NULL, NULL, 0));
             return t;
         }
         case EXPR_EQ: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SUB, t, l, r, 0));
-            append_ir(first, tail, new_ir(IR_SLTIU, t, t, NULL, 1));  // t = (diff < 1) i.e. ==0
-            append_ir(first, tail, new_ir(IR_XORI, t, t, NULL, 1));  // Invert for EQ
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_SUB, t, l, r, 0));
+            append_ir(first, tail, new_ir(func, IR_SLTIU, t, t, NULL, 1));  // t = (diff < 1) i.e. ==0
             return t;
         }
         case EXPR_NEQ: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SUB, t, l, r, 0));
-            append_ir(first, tail, new_ir(IR_SLTIU, t, t, NULL, 1));  // 1 if !=0
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_SUB, t, l, r, 0));
+            append_ir(first, tail, new_ir(func, IR_SLTU, t, "$zero", t, 0));  // 1 if !=0
             return t;
         }
         case EXPR_LT: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SLT, t, l, r, 0));
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, slt_op(e, func), t, l, r, 0));
             return t;
         }
         case EXPR_GT: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SLT, t, r, l, 0));  // Swap for GT
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, slt_op(e, func), t, r, l, 0));  // Swap for GT
             return t;
         }
         case EXPR_LEQ: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SLT, t, r, l, 0));  // ! (r < l)
-            append_ir(first, tail, new_ir(IR_XORI, t, t, NULL, 1));
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, slt_op(e, func), t, r, l, 0));  // ! (r < l)
+            append_ir(first, tail, new_ir(func, IR_XORI, t, t, NULL, 1));
             return t;
         }
         case EXPR_GEQ: {
-            char* l = lower_expr(e->left, func, first, tail);
-            char* r = lower_expr(e->right, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SLT, t, l, r, 0));  // ! (l < r)
-            append_ir(first, tail, new_ir(IR_XORI, t, t, NULL, 1));
+            char* l;
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, slt_op(e, func), t, l, r, 0));  // ! (l < r)
+            append_ir(first, tail, new_ir(func, IR_XORI, t, t, NULL, 1));
             return t;
         }
         case EXPR_NEG: {
             char* op = lower_expr(e->left, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_SUB, t, "$zero", op, 0));
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_SUB, t, "$zero", op, 0));
             return t;
         }
         case EXPR_NOT: {
             char* op = lower_expr(e->left, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_XORI, t, op, NULL, 1));  // Flip bool
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_XORI, t, op, NULL, 1));  // Flip bool
             return t;
         }
         case EXPR_ALLOC: {
             // For new T@, use syscall or heap routine (OS dev implements alloc via SYSC)
             // Placeholder: assume "malloc" routine
-            append_ir(first, tail, new_ir(IR_LI, "$a0", NULL, NULL, 4));  // Size from type
-            append_ir(first, tail, new_ir(IR_SYSC, NULL, NULL, NULL, 9));  // sbrk syscall code 9
+            type_t named = { .kind = TYPE_NAMED, .name = e->name };
+            append_ir(first, tail, new_ir(func, IR_LI, "$a0", NULL, NULL, ir_type_size(&named)));  // Size from type
+            append_ir(first, tail, new_ir(func, IR_SYSC, NULL, NULL, NULL, 9));  // sbrk syscall code 9
             // Note: SYSC for alloc is to be implemented by OS developer
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_MOVE, t, "$v0", NULL, 0));
+            char* t = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_MOVE, t, "$v0", NULL, 0));
             return t;
         }
+        case EXPR_ADDR: {
+            return lower_addr(e->left, func, first, tail);
+        }
+        default:
+            fprintf(stderr, "Unhandled expr kind %d\n", e->kind);
+            exit(1);
+    }
+ 
+    return NULL;
+}
+
+
+// Jump to label when e evaluates to jump_if (0 or 1), fall through otherwise. && and || skip their
+// right operand as soon as the left one decides the outcome; comparisons fuse into the branch itself
+// (beq/bne, sign tests against zero) instead of materializing a 0/1 first
+static void lower_branch(expr_t* e, char* label, int jump_if, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    switch (e->kind) {
+        case EXPR_AND:
+        case EXPR_OR: {
+            int is_and = e->kind == EXPR_AND;
+            if (jump_if != is_and) {  // Either operand alone decides: && jumping on false, || on true
+                lower_branch(e->left, label, jump_if, func, first, tail);
+                lower_branch(e->right, label, jump_if, func, first, tail);
+                return;
+            }
+            char* skip = new_label(func);  // Left operand decided the other way: the right one is not evaluated
+            lower_branch(e->left, skip, !jump_if, func, first, tail);
+            lower_branch(e->right, label, jump_if, func, first, tail);
+            append_ir(first, tail, new_ir(func, IR_LABEL, skip, NULL, NULL, 0));
+            return;
+        }
+        case EXPR_NOT:
+            lower_branch(e->left, label, !jump_if, func, first, tail);
+            return;
+        case EXPR_BOOL:
+            if ((e->bool_val ? 1 : 0) == jump_if) append_ir(first, tail, new_ir(func, IR_J, label, NULL, NULL, 0));
+            return;
+        case EXPR_EQ:
+        case EXPR_NEQ: {
+            char* l;  // Literal zeros read $zero
+            char* r;
+            lower_pair(e->left, e->right, &l, &r, func, first, tail);
+            int beq = (e->kind == EXPR_EQ) == jump_if;
+            append_ir(first, tail, new_ir(func, beq ? IR_BEQ : IR_BNE, label, l, r, 0));
+            return;
+        }
+        case EXPR_LT:
+        case EXPR_GT:
+        case EXPR_LEQ:
+        case EXPR_GEQ: {
+            // Normalize to l < r (LT, GT) or l <= r (LEQ, GEQ) by swapping operands
+            int swap = e->kind == EXPR_GT || e->kind == EXPR_GEQ;
+            int strict = e->kind == EXPR_LT || e->kind == EXPR_GT;
+            expr_t* a = swap ? e->right : e->left;
+            expr_t* b = swap ? e->left : e->right;
+            int is_unsigned = expr_is_unsigned(e->left, func);
+            int c;
+            int zero_left = const_value(a, &c) && c == 0;
+            int zero_right = const_value(b, &c) && c == 0;
+            if (!is_unsigned && (zero_left || zero_right)) {
+                // Against zero: one sign-testing branch. x < 0, x <= 0, 0 < x, 0 <= x and their negations
+                char* x = lower_expr(zero_right ? a : b, func, first, tail);
+                ir_op_t op;
+                if (zero_right) op = strict ? (jump_if ? IR_BLTZ : IR_BGEZ) : (jump_if ? IR_BLEZ : IR_BGTZ);
+                else op = strict ? (jump_if ? IR_BGTZ : IR_BLEZ) : (jump_if ? IR_BGEZ : IR_BLTZ);
+                append_ir(first, tail, new_ir(func, op, label, x, NULL, 0));
+                return;
+            }
+            imm_tile_t tile;
+            if (match_slt_imm(e, is_unsigned, &tile)) {  // slti against the literal, then test its result
+                char* x = lower_expr(tile.x, func, first, tail);
+                char* t = new_temp(func);
+                append_ir(first, tail, new_ir(func, is_unsigned ? IR_SLTIU : IR_SLTI, t, x, NULL, tile.imm));
+                int branch_if_set = (!tile.negate) == jump_if;
+                append_ir(first, tail, new_ir(func, branch_if_set ? IR_BNE : IR_BEQ, label, t, "$zero", 0));
+                return;
+            }
+            char* l;
+            char* r;
+            lower_pair(a, b, &l, &r, func, first, tail);
+            char* t = new_temp(func);
+            // l < r is slt l, r; l <= r is !(r < l), so the test flips
+            append_ir(first, tail, new_ir(func, slt_op(e, func), t, strict ? l : r, strict ? r : l, 0));
+            int branch_if_set = strict == jump_if;
+            append_ir(first, tail, new_ir(func, branch_if_set ? IR_BNE : IR_BEQ, label, t, "$zero", 0));
+            return;
+        }
+        default: {
+            char* v = lower_expr(e, func, first, tail);
+            append_ir(first, tail, new_ir(func, jump_if ? IR_BNE : IR_BEQ, label, v, "$zero", 0));
+            return;
+        }
+    }
+}
+
+
+// idx * size, by doubling for powers of two and as a multiply pseudo-op otherwise
+static char* lower_scale(char* idx, int size, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    if (size > 0 && (size & (size - 1)) == 0) {
+        char* cur = idx;
+        for (int k = size; k > 1; k >>= 1) {
+            char* doubled = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_ADD, doubled, cur, cur, 0));  // *2
+            cur = doubled;
+        }
+        return cur;
+    }
+    char* sz = new_temp(func);
+    append_ir(first, tail, new_ir(func, IR_LI, sz, NULL, NULL, size));
+    char* t = new_temp(func);
+    append_ir(first, tail, new_ir(func, IR_MUL, t, idx, sz, 0));
+    return t;
+}
+
+
+// Lower an lvalue to a base register plus a constant offset: field offsets and constant index terms
+// fold into the immediate of the lw/sw using the address instead of costing an addi each
+static char* lower_addr_mode(expr_t* e, int* offset, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    long long off = 0;
+    char* base;
+    switch (e->kind) {
+        case EXPR_ID: {
+            base = new_temp(func);
+            append_ir(first, tail, new_ir(func, IR_LA, base, e->name, NULL, 0));  // Load address if global/var
+            break;
+        }
         case EXPR_FIELD: {
-            char* base = lower_expr(e->left, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_ADDI, t, base, NULL, 0));  // Offset from type
-            return t;
+            int inner;
+            base = lower_addr_mode(e->left, &inner, func, first, tail);
+            off = (long long)inner + field_offset(lvalue_type(e->left, func), e->name);  // Offset from type
+            break;
         }
         case EXPR_INDEX: {
-            char* base = lower_expr(e->left, func, first, tail);
-            char* idx = lower_expr(e->right, func, first, tail);
-            char* scaled = new_temp();
-            append_ir(first, tail, new_ir(IR_ADD, scaled, idx, idx, 0));  // *2
-            char* scaled4 = new_temp();
-            append_ir(first, tail, new_ir(IR_ADD, scaled4, scaled, scaled, 0));  // *4
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_ADD, t, base, scaled4, 0));
-            return t;
+            type_t* at = lvalue_type(e->left, func);
+            int size = at ? ir_type_size(at->subtype) : 4;
+            // a[i + c] is a[i] displaced by c elements
+            expr_t* idx = e->right;
+            int c = 0;
+            if (const_value(idx, &c)) idx = NULL;
+            else if (idx->kind == EXPR_ADD && const_value(idx->right, &c)) idx = idx->left;
+            else if (idx->kind == EXPR_ADD && const_value(idx->left, &c)) idx = idx->right;
+            else if (idx->kind == EXPR_SUB && const_value(idx->right, &c) && c != (int)0x80000000) {
+                c = -c;
+                idx = idx->left;
+            } else c = 0;
+            // Like any operand pair: a heavier side-effect-free index goes before the array address
+            char* scaled = NULL;
+            label_expr(e->left);
+            if (idx) label_expr(idx);
+            int idx_first = idx && e->left->pure && idx->pure && idx->regs > e->left->regs;
+            if (idx_first) {
+                operands_swapped++;
+                scaled = lower_scale(lower_expr(idx, func, first, tail), size, func, first, tail);
+            }
+            int inner;
+            base = lower_addr_mode(e->left, &inner, func, first, tail);
+            if (idx && !idx_first) scaled = lower_scale(lower_expr(idx, func, first, tail), size, func, first, tail);
+            off = (long long)inner + (long long)c * size;
+            if (idx) {
+                char* t = new_temp(func);
+                append_ir(first, tail, new_ir(func, IR_ADD, t, base, scaled, 0));
+                base = t;
+            }
+            break;
         }
         case EXPR_DEREF: {
-            char* ptr = lower_expr(e->left, func, first, tail);
-            char* t = new_temp();
-            append_ir(first, tail, new_ir(IR_LW, t, ptr, NULL, 0));
-            return t;
-        }
-        case EXPR_ADDR: {
-            char* val = lower_expr(e->left, func, first, tail);
-            return val;  // Addr is base (use LA if global)
+            base = lower_expr(e->left, func, first, tail);  // The pointer value is the address
+            break;
         }
         default:
-            fprintf(stderr, "Unhandled expr kind %d\n", e->kind);
+            fprintf(stderr, "Expr kind %d is not an lvalue\n", e->kind);
             exit(1);
     }
- 
-    return NULL;
+    if (!fits_simm16(off)) {  // Beyond the 16-bit displacement: add it to the base
+        char* t = new_temp(func);
+        append_ir(first, tail, new_ir(func, IR_ADD, t, base, lower_const((int)off, func, first, tail), 0));
+        base = t;
+        off = 0;
+    }
+    *offset = (int)off;
+    return base;
+}
+
+
+// Lower an lvalue - returns name of temp holding its address
+static char* lower_addr(expr_t* e, ir_func_t* func, ir_instr_t** first, ir_instr_t** tail) {
+    int offset;
+    char* base = lower_addr_mode(e, &offset, func, first, tail);
+    if (offset == 0) return base;
+    char* t = new_temp(func);
+    append_ir(first, tail, new_ir(func, IR_ADDI, t, base, NULL, offset));
+    return t;
+}
+
+
+// Conditional branches end a basic block and fall through when not taken
+int ir_is_cond_branch(ir_op_t op) {
+    return op == IR_BEQ || op == IR_BNE || op == IR_BLTZ || op == IR_BGEZ || op == IR_BLEZ || op == IR_BGTZ;
+}
+
+
+// Instructions after which control never falls through to the next one
+int ir_is_unconditional_jump(ir_op_t op) {
+    return op == IR_J || op == IR_JR;
+}
+
+
+int ir_vreg_id(const char* name) {
+    if (!name || name[0] != 't') return -1;
+    int id = 0;
+    for (const char* c = name + 1; *c; c++) {
+        if (*c < '0' || *c > '9') return -1;
+        id = id * 10 + (*c - '0');
+    }
+    return name[1] ? id : -1;
+}
+
+
+char** ir_def(ir_instr_t* i) {
+    switch (i->op) {
+        case IR_SW:
+        case IR_BLTZ: case IR_BGEZ: case IR_BEQ: case IR_BNE: case IR_BLEZ: case IR_BGTZ:
+        case IR_J: case IR_JAL: case IR_JR:
+        case IR_SYSC: case IR_ERET: case IR_LABEL: case IR_NOP:
+            return NULL;
+        default:
+            return i->dest ? &i->dest : NULL;
+    }
+}
+
+
+int ir_uses(ir_instr_t* i, char** slots[2]) {
+    int n = 0;
+    switch (i->op) {
+        case IR_SW:  // sw value, imm(base)
+            if (i->dest) slots[n++] = &i->dest;
+            if (i->src1) slots[n++] = &i->src1;
+            break;
+        case IR_LI: case IR_LA: case IR_LUI: case IR_LABEL: case IR_J: case IR_JAL:
+        case IR_SYSC: case IR_ERET: case IR_NOP: case IR_PHI:
+            break;
+        case IR_ADD: case IR_ADDU: case IR_SUB: case IR_SUBU: case IR_AND: case IR_OR:
+        case IR_XOR: case IR_NOR: case IR_SLT: case IR_SLTU: case IR_BEQ: case IR_BNE:
+        case IR_MUL: case IR_DIV: case IR_DIVU:
+            if (i->src1) slots[n++] = &i->src1;
+            if (i->src2) slots[n++] = &i->src2;
+            break;
+        default:  // One register source: I-type ALU, loads, moves, single-register branches, jr
+            if (i->src1) slots[n++] = &i->src1;
+            break;
+    }
+    return n;
+}
+
+
+int ir_may_alias(const mem_tag_t* a, const mem_tag_t* b) {
+    if (!a || !b) return 1;
+    if (a->type != b->type) return 0;
+    if (a->kind == MEM_DEREF || b->kind == MEM_DEREF) return 1;  // Through & or new, p@ reaches any word of its type
+    if (a->kind != b->kind) return 0;
+    return a->kind == MEM_ELEM || a->key == b->key;  // Arrays are only told apart by their element type
 }
 
 
 // Debug print
+void print_ir_instr(const ir_instr_t* i, FILE* out) {
+    if (i->op == IR_LABEL) {
+        fprintf(out, "%s:", i->dest);
+    } else {
+        const char* mn = "";
+        switch (i->op) {
+            case IR_LW: mn = "lw"; break;
+            case IR_SW: mn = "sw"; break;
+            case IR_ADDI: mn = "addi"; break;
+            case IR_ADDIU: mn = "addiu"; break;
+            case IR_SLTI: mn = "slti"; break;
+            case IR_SLTIU: mn = "sltiu"; break;
+            case IR_ANDI: mn = "andi"; break;
+            case IR_ORI: mn = "ori"; break;
+            case IR_XORI: mn = "xori"; break;
+            case IR_LUI: mn = "lui"; break;
+            case IR_ADD: mn = "add"; break;
+            case IR_ADDU: mn = "addu"; break;
+            case IR_SUB: mn = "sub"; break;
+            case IR_SUBU: mn = "subu"; break;
+            case IR_AND: mn = "and"; break;
+            case IR_OR: mn = "or"; break;
+            case IR_XOR: mn = "xor"; break;
+            case IR_NOR: mn = "nor"; break;
+            case IR_SLT: mn = "slt"; break;
+            case IR_SLTU: mn = "sltu"; break;
+            case IR_SRL: mn = "srl"; break;
+            case IR_BLTZ: mn = "bltz"; break;
+            case IR_BGEZ: mn = "bgez"; break;
+            case IR_BEQ: mn = "beq"; break;
+            case IR_BNE: mn = "bne"; break;
+            case IR_BLEZ: mn = "blez"; break;
+            case IR_BGTZ: mn = "bgtz"; break;
+            case IR_J: mn = "j"; break;
+            case IR_JAL: mn = "jal"; break;
+            case IR_JR: mn = "jr"; break;
+            case IR_JALR: mn = "jalr"; break;
+            case IR_SYSC: {
+                mn = "syscall";
+                // Note: SYSC is to be implemented by OS developer
+                break;
+            }
+            case IR_ERET: {
+                mn = "eret";
+                // Note: ERET is to be implemented by OS developer
+                break;
+            }
+            case IR_MOVG2S: {
+                mn = "movg2s";
+                // Note: MOVG2S is to be implemented by OS developer
+                break;
+            }
+            case IR_MOVS2G: {
+                mn = "movs2g";
+                // Note: MOVS2G is to be implemented by OS developer
+                break;
+            }
+            case IR_LI: mn = "li"; break;
+            case IR_LA: mn = "la"; break;
+            case IR_MOVE: mn = "move"; break;
+            case IR_MUL: mn = "mul"; break;
+            case IR_DIV: mn = "div"; break;
+            case IR_DIVU: mn = "divu"; break;
+            case IR_NOP: mn = "nop"; break;
+            case IR_PHI: mn = "phi"; break;
+            default: mn = "unknown";
+        }
+        fprintf(out, "%s ", mn);
+        if (i->op == IR_PHI) {
+            fprintf(out, "%s, [", i->dest);
+            for (int k = 0; k < i->nargs; k++) fprintf(out, "%s%s", k ? ", " : "", i->args[k]);
+            fprintf(out, "]\n");
+            return;
+        }
+        int has_imm = (i->op >= IR_LW && i->op <= IR_LUI) || i->op == IR_SRL || i->op == IR_LI;
+        if (i->dest) fprintf(out, "%s, ", i->dest);
+        if (i->src1) fprintf(out, "%s, ", i->src1);
+        if (i->src2) fprintf(out, "%s", i->src2);
+        else if (i->imm || has_imm) fprintf(out, "%d", i->imm);
+    }
+    fprintf(out, "\n");
+}
+
+
 void print_ir(const ir_program_t* ir) {
     printf(".data\n");
     // globals... (emit labels/init)
     for (decl_t* g = ir->globals; g; g = g->next) {
-        if (g->kind == DECL_VAR) {
+        if (g->kind == DECL_VAR && !ir_global_is_dead(ir, g->name)) {
             printf("%s: .word 0\n", g->name);  // Simple init
         }
     }
@@ -357,97 +1137,46 @@ void print_ir(const ir_program_t* ir) {
         printf("%s:\n", f->name);
         for (ir_instr_t* i = f->body; i; i = i->next) {
             printf("  ");
-            if (i->op == IR_LABEL) {
-                printf("%s:", i->dest);
-            } else {
-                const char* mn = "";
-                switch (i->op) {
-                    case IR_LW: mn = "lw"; break;
-                    case IR_SW: mn = "sw"; break;
-                    case IR_ADDI: mn = "addi"; break;
-                    case IR_ADDIU: mn = "addiu"; break;
-                    case IR_SLTI: mn = "slti"; break;
-                    case IR_SLTIU: mn = "sltiu"; break;
-                    case IR_ANDI: mn = "andi"; break;
-                    case IR_ORI: mn = "ori"; break;
-                    case IR_XORI: mn = "xori"; break;
-                    case IR_LUI: mn = "lui"; break;
-                    case IR_ADD: mn = "add"; break;
-                    case IR_ADDU: mn = "addu"; break;
-                    case IR_SUB: mn = "sub"; break;
-                    case IR_SUBU: mn = "subu"; break;
-                    case IR_AND: mn = "and"; break;
-                    case IR_OR: mn = "or"; break;
-                    case IR_XOR: mn = "xor"; break;
-                    case IR_NOR: mn = "nor"; break;
-                    case IR_SLT: mn = "slt"; break;
-                    case IR_SLTU: mn = "sltu"; break;
-                    case IR_SRL: mn = "srl"; break;
-                    case IR_BLTZ: mn = "bltz"; break;
-                    case IR_BGEZ: mn = "bgez"; break;
-                    case IR_BEQ: mn = "beq"; break;
-                    case IR_BNE: mn = "bne"; break;
-                    case IR_BLEZ: mn = "blez"; break;
-                    case IR_BGTZ: mn = "bgtz"; break;
-                    case IR_J: mn = "j"; break;
-                    case IR_JAL: mn = "jal"; break;
-                    case IR_JR: mn = "jr"; break;
-                    case IR_JALR: mn = "jalr"; break;
-                    case IR_SYSC: {
-                        mn = "syscall";
-                        // Note: SYSC is to be implemented by OS developer
-                        break;
-                    }
-                    case IR_ERET: {
-                        mn = "eret";
-                        // Note: ERET is to be implemented by OS developer
-                        break;
-                    }
-                    case IR_MOVG2S: {
-                        mn = "movg2s";
-                        // Note: MOVG2S is to be implemented by OS developer
-                        break;
-                    }
-                    case IR_MOVS2G: {
-                        mn = "movs2g";
-                        // Note: MOVS2G is to be implemented by OS developer
-                        break;
-                    }
-                    case IR_LI: mn = "li"; break;
-                    case IR_LA: mn = "la"; break;
-                    case IR_MOVE: mn = "move"; break;
-                    case IR_NOP: mn = "nop"; break;
-                    default: mn = "unknown";
-                }
-                printf("%s ", mn);
-                if (i->dest) printf("%s, ", i->dest);
-                if (i->src1) printf("%s, ", i->src1);
-                if (i->src2) printf("%s", i->src2);
-                else if (i->imm) printf("%d", i->imm);
-            }
-            printf("\n");
+            print_ir_instr(i, stdout);
         }
     }
 }
 
 
 // Free
+void free_ir_func(ir_func_t* f) {
+    arena_destroy(f->arena);  // Instructions, operand names and labels all live in the arena
+    f->arena = NULL;
+    f->name = NULL;
+    f->body = NULL;
+    f->names = NULL;
+    f->names_cap = 0;
+    f->names_count = 0;
+}
+
+
+int ir_global_is_dead(const ir_program_t* ir, const char* name) {
+    for (int k = 0; k < ir->ndead_globals; k++) {
+        if (strcmp(ir->dead_globals[k], name) == 0) return 1;
+    }
+    return 0;
+}
+
+
 void free_ir(ir_program_t* ir) {
     ir_func_t* f = ir->functions;
     while (f) {
         ir_func_t* next_f = f->next;
-        free(f->name);
-        ir_instr_t* i = f->body;
-        while (i) {
-            ir_instr_t* next_i = i->next;
-            free(i->dest);
-            free(i->src1);
-            free(i->src2);
-            free(i);
-            i = next_i;
-        }
+        free_ir_func(f);
         free(f);
         f = next_f;
     }
+    free(ir->dead_globals);
     free(ir);
 }
+
+
+void print_ir_stats(FILE* out) {
+    fprintf(out, "IR arena peak: %zu bytes\n", arena_peak_bytes());
+    fprintf(out, "Sethi-Ullman: %d operand pairs evaluated right to left\n", operands_swapped);
+}
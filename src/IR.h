@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include "parser.h"
+#include "arena.h"
 
 // IR opcodes
 typedef enum {
@@ -45,8 +46,8 @@ typedef enum {
 
     // Jumps
     IR_J,  // j label
-    IR_JAL,  // jal label
-    IR_JR,  // jr rs
+    IR_JAL,  // jal label  (imm: number of arguments passed on the stack)
+    IR_JR,  // jr rs  (imm: 1 for a return on a path that never set up the frame)
     IR_JALR,  // jalr rd, rs
 
     // System / Coprocessor
@@ -60,27 +61,84 @@ typedef enum {
     IR_LI,  // li rt, imm  (pseudo: load immediate)
     IR_LA,  // la rt, label  (pseudo: load address)
     IR_MOVE,  // move rd, rs  (pseudo)
-    IR_NOP  // nop
+    IR_MUL,  // mul rd, rs, rt  (pseudo: shift/add chain or a call to mult)
+    IR_DIV,  // div rd, rs, rt  (pseudo: signed, truncating; srl-based sequence or a call to div)
+    IR_DIVU,  // divu rd, rs, rt  (pseudo: unsigned; srl or a call to divu)
+    IR_NOP,  // nop
+
+    // SSA only (removed again before code generation)
+    IR_PHI  // phi rd, [args...]  (one argument per predecessor of the block)
 } ir_op_t;
 
 
+// Type-based alias class of a load or store. C0 has no casts or pointer arithmetic, so a word is only
+// ever read and written as the scalar it was declared as: words of different types never overlap, nor
+// do two different variables or fields. Only p@ reaches words of its type through & and new
+typedef enum {
+    MEM_VAR,  // Scalar variable (key: interned name)
+    MEM_FIELD,  // Scalar struct field (key: the field's declaration)
+    MEM_ELEM,  // Array element
+    MEM_DEREF  // p@ with p pointing to a scalar
+} mem_kind_t;
+
+
+typedef struct {
+    mem_kind_t kind;
+    type_kind_t type;  // Scalar type of the word
+    const void* key;
+} mem_tag_t;
+
+
 typedef struct ir_instr {
     ir_op_t op;
     char* dest;  // rd / rt / label name
     char* src1;  // rs / rt / base
     char* src2;  // rt / imm (as string for labels) / sa
     int imm;  // immediate value (used when src2 is NULL)
+    char** args;  // IR_PHI operands, in the order of the block's predecessors
+    int nargs;
+    const mem_tag_t* mem;  // IR_LW/IR_SW: alias class of the word accessed (NULL: may be any word)
     struct ir_instr* next;
 } ir_instr_t;
 
 
-// Function IR
+// Calling convention: arguments 0-3 in $a0-$a3, the rest in the caller's outgoing-argument area,
+// argument k at 4(k - NUM_ARG_REGS)($sp); the result comes back in $v0
+#define NUM_ARG_REGS 4
+
+
+// Local variable or parameter of a function (addressed by name via IR_LA until frame layout)
+typedef struct ir_var {
+    char* name;
+    type_t* type;  // With typedef names resolved
+    int size;  // Bytes
+    int is_param;
+    int param_index;  // Position in the parameter list, -1 for locals
+    int offset;  // Frame layout: from $fp (the caller's $sp) for stack params, from $sp otherwise; -1 if not in memory
+    struct ir_var* next;
+} ir_var_t;
+
+
+// Function IR (instructions, operand names and labels are owned by the function's arena)
 typedef struct ir_func {
+    arena_t* arena;
+    char** names;  // Intern table for operand names (open addressing, power-of-two capacity)
+    int names_cap;
+    int names_count;
     char* name;
     type_t* ret_type;
     param_t* params;
     decl_t* ast;
+    ir_var_t* vars;  // Params first, then locals in declaration order
     ir_instr_t* body;
+    int spill_base;  // Offset from $sp of the first spill slot, above outgoing arguments and locals (frame layout)
+    int spill_slots;  // Stack words for spilled registers (set by register allocation)
+    unsigned saved_regs;  // Callee-saved registers the function writes, bit k for $sk (saved by the prologue)
+    int slot_savings;  // Frame bytes saved by letting locals and spilled values share slots (for --stats)
+    int frame_size;  // Bytes of stack the prologue allocates, fixed once registers are allocated (0: no frame)
+    int is_leaf;  // Makes no calls, so $ra and $fp are neither saved nor set up
+    ir_instr_t* save_point;  // Shrink-wrapping: label the prologue follows (NULL: function entry)
+    ir_instr_t* restore_point;  // Shrink-wrapping: instruction the frame is torn down after (NULL: in the epilogue); the delay slot once a call has one
     struct ir_func* next;
 } ir_func_t;
 
@@ -89,6 +147,8 @@ typedef struct ir_func {
 typedef struct {
     decl_t* globals;  // Global variables / types (kept from AST)
     ir_func_t* functions;
+    char** dead_globals;  // Names of global variables no function uses (not emitted)
+    int ndead_globals;
 } ir_program_t;
 
 
@@ -97,6 +157,42 @@ ir_program_t* lower_to_ir(decl_t* program_ast);
 
 void print_ir(const ir_program_t* ir);
 
+void print_ir_instr(const ir_instr_t* i, FILE* out);
+
+char* ir_intern(ir_func_t* f, const char* name);  // Arena copy of name shared by all its uses in f
+
+ir_instr_t* new_ir(ir_func_t* func, ir_op_t op, char* dest, char* src1, char* src2, int imm);
+
+void append_ir(ir_instr_t** first, ir_instr_t** tail, ir_instr_t* instr);
+
+char* new_temp(ir_func_t* func);  // Fresh virtual register tN
+
+char* new_label(ir_func_t* func);  // Fresh label LN
+
+int ir_is_cond_branch(ir_op_t op);
+
+int ir_vreg_id(const char* name);  // N for a virtual register tN, -1 for physical registers
+
+char** ir_def(ir_instr_t* i);  // Slot of the register written by i, or NULL
+
+int ir_uses(ir_instr_t* i, char** slots[2]);  // Slots of the registers read by i (phi arguments excluded)
+
+int ir_may_alias(const mem_tag_t* a, const mem_tag_t* b);  // Could accesses tagged a and b touch the same word?
+
+ir_var_t* ir_find_var(ir_func_t* f, const char* name);  // Local or param, NULL for globals
+
+int ir_global_is_dead(const ir_program_t* ir, const char* name);
+
+type_t* ir_resolve_type(type_t* t);  // Follow typedef names
+
+int ir_type_size(type_t* t);
+
+int ir_is_unconditional_jump(ir_op_t op);
+
+void free_ir_func(ir_func_t* f);  // Drop one function's IR in a single call
+
 void free_ir(ir_program_t* ir);
 
+void print_ir_stats(FILE* out);
+
 #endif
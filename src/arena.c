@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+
+#define ARENA_CHUNK_SIZE 8192  // Default chunk payload; larger requests get a chunk of their own
+#define ARENA_ALIGN (sizeof(void*))
+
+
+static size_t live_bytes = 0;
+static size_t peak_bytes = 0;
+
+
+static arena_chunk_t* new_chunk(arena_t* a, size_t cap) {
+    arena_chunk_t* c = malloc(sizeof(arena_chunk_t) + cap);
+    if (!c) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    c->used = 0;
+    c->cap = cap;
+    c->next = a->head;
+    a->head = c;
+
+    a->reserved += sizeof(arena_chunk_t) + cap;
+    live_bytes += sizeof(arena_chunk_t) + cap;
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+    return c;
+}
+
+
+arena_t* arena_create(void) {
+    arena_t* a = malloc(sizeof(arena_t));
+    if (!a) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    a->head = NULL;
+    a->reserved = 0;
+    return a;
+}
+
+
+void* arena_alloc(arena_t* a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);  // Keep every allocation pointer-aligned
+
+    arena_chunk_t* c = a->head;
+    if (!c || c->cap - c->used < size) {
+        if (size > ARENA_CHUNK_SIZE / 4) {
+            // Big request: give it a dedicated chunk behind the current one so the
+            // remaining space of the current chunk is not wasted
+            c = new_chunk(a, size);
+            if (c->next) {
+                a->head = c->next;
+                c->next = a->head->next;
+                a->head->next = c;
+            }
+        } else {
+            c = new_chunk(a, ARENA_CHUNK_SIZE);
+        }
+    }
+
+    void* p = c->data + c->used;
+    c->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+
+char* arena_strdup(arena_t* a, const char* s) {
+    size_t len = strlen(s) + 1;
+    char* p = arena_alloc(a, len);
+    memcpy(p, s, len);
+    return p;
+}
+
+
+void arena_destroy(arena_t* a) {
+    if (!a) return;
+    arena_chunk_t* c = a->head;
+    while (c) {
+        arena_chunk_t* next = c->next;
+        free(c);
+        c = next;
+    }
+    live_bytes -= a->reserved;
+    free(a);
+}
+
+
+size_t arena_live_bytes(void) {
+    return live_bytes;
+}
+
+
+size_t arena_peak_bytes(void) {
+    return peak_bytes;
+}
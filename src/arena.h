@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>  // size_t
+
+
+// One block of arena memory; allocations are carved out of data[] by bumping used
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t used;
+    size_t cap;
+    char data[];
+} arena_chunk_t;
+
+
+// Bump allocator: everything allocated from it is released at once by arena_destroy
+typedef struct arena {
+    arena_chunk_t* head;  // Chunk currently being filled (older chunks follow)
+    size_t reserved;  // Bytes obtained from malloc for this arena
+} arena_t;
+
+
+// Create an empty arena (the first chunk is allocated lazily)
+arena_t* arena_create(void);
+
+
+// Allocate size bytes (zeroed, pointer-aligned) from the arena
+void* arena_alloc(arena_t* a, size_t size);
+
+
+// Copy a string into the arena
+char* arena_strdup(arena_t* a, const char* s);
+
+
+// Release every chunk of the arena and the arena itself
+void arena_destroy(arena_t* a);
+
+
+// Bytes currently reserved by all live arenas, and the high-water mark of that number
+size_t arena_live_bytes(void);
+size_t arena_peak_bytes(void);
+
+#endif
@@ -0,0 +1,683 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cfg.h"
+
+
+static void push_block(cfg_t* cfg, bb_t* b) {
+    if (cfg->nblocks == cfg->blocks_cap) {
+        int cap = cfg->blocks_cap ? cfg->blocks_cap * 2 : 16;
+        bb_t** blocks = arena_alloc(cfg->arena, cap * sizeof(bb_t*));
+        if (cfg->nblocks) memcpy(blocks, cfg->blocks, cfg->nblocks * sizeof(bb_t*));
+        cfg->blocks = blocks;
+        cfg->blocks_cap = cap;
+    }
+    b->id = cfg->nblocks;
+    cfg->blocks[cfg->nblocks++] = b;
+}
+
+
+static bb_t* alloc_block(cfg_t* cfg) {
+    bb_t* b = arena_alloc(cfg->arena, sizeof(bb_t));
+    b->rpo = -1;
+    push_block(cfg, b);
+    return b;
+}
+
+
+static void append_instr(bb_t* b, ir_instr_t* i) {
+    i->next = NULL;
+    if (b->last) b->last->next = i;
+    else b->first = i;
+    b->last = i;
+}
+
+
+static void push_edge(cfg_t* cfg, bb_t*** arr, int* n, int* cap, bb_t* b) {
+    if (*n == *cap) {
+        int new_cap = *cap ? *cap * 2 : 2;
+        bb_t** grown = arena_alloc(cfg->arena, new_cap * sizeof(bb_t*));
+        if (*n) memcpy(grown, *arr, *n * sizeof(bb_t*));
+        *arr = grown;
+        *cap = new_cap;
+    }
+    (*arr)[(*n)++] = b;
+}
+
+
+void cfg_add_edge(cfg_t* cfg, bb_t* from, bb_t* to) {
+    push_edge(cfg, &from->succs, &from->nsuccs, &from->succs_cap, to);
+    push_edge(cfg, &to->preds, &to->npreds, &to->preds_cap, from);
+}
+
+
+static void remove_one(bb_t** arr, int* n, bb_t* b) {
+    for (int k = 0; k < *n; k++) {
+        if (arr[k] == b) {
+            memmove(&arr[k], &arr[k + 1], (*n - k - 1) * sizeof(bb_t*));  // Keep order: succs[0]/[1] have meaning
+            (*n)--;
+            return;
+        }
+    }
+}
+
+
+void cfg_remove_edge(bb_t* from, bb_t* to) {
+    remove_one(from->succs, &from->nsuccs, to);
+    remove_one(to->preds, &to->npreds, from);
+}
+
+
+int cfg_pred_index(bb_t* b, bb_t* pred) {
+    for (int k = 0; k < b->npreds; k++) {
+        if (b->preds[k] == pred) return k;
+    }
+    return -1;
+}
+
+
+void cfg_redirect_edge(cfg_t* cfg, bb_t* from, bb_t* to, bb_t* new_to) {
+    int si = 0;
+    while (from->succs[si] != to) si++;
+    from->succs[si] = new_to;
+    remove_one(to->preds, &to->npreds, from);
+    push_edge(cfg, &new_to->preds, &new_to->npreds, &new_to->preds_cap, from);
+    ir_instr_t* last = from->last;
+    if (last && ((ir_is_cond_branch(last->op) && si == 0) || last->op == IR_J)) last->dest = new_to->label;
+}
+
+
+bb_t* cfg_new_block(cfg_t* cfg) {
+    bb_t* b = alloc_block(cfg);
+    b->label = new_label(cfg->func);
+    append_instr(b, new_ir(cfg->func, IR_LABEL, b->label, NULL, NULL, 0));
+    return b;
+}
+
+
+static void insert_block_at(cfg_t* cfg, bb_t* b, int pos) {
+    // b was just appended: slide it into place and renumber everything after it
+    memmove(&cfg->blocks[pos + 1], &cfg->blocks[pos], (cfg->nblocks - 1 - pos) * sizeof(bb_t*));
+    cfg->blocks[pos] = b;
+    for (int k = pos; k < cfg->nblocks; k++) cfg->blocks[k]->id = k;
+}
+
+
+bb_t* cfg_split_edge(cfg_t* cfg, bb_t* from, bb_t* to) {
+    bb_t* n = cfg_new_block(cfg);
+    int si = -1;
+    for (int k = 0; k < from->nsuccs; k++) {
+        if (from->succs[k] == to) {
+            si = k;
+            break;
+        }
+    }
+    from->succs[si] = n;
+    to->preds[cfg_pred_index(to, from)] = n;
+    push_edge(cfg, &n->preds, &n->npreds, &n->preds_cap, from);
+    push_edge(cfg, &n->succs, &n->nsuccs, &n->succs_cap, to);
+
+    ir_instr_t* last = from->last;
+    int taken = last && ((ir_is_cond_branch(last->op) && si == 0) || last->op == IR_J);
+    if (taken) last->dest = n->label;  // Retarget the branch; n jumps on to `to` when linearized
+    else insert_block_at(cfg, n, from->id + 1);  // Fall-through edge: keep falling through n
+    n->rpo = from->rpo;  // Reachable; callers reanalyze when they need exact numbers
+    return n;
+}
+
+
+void cfg_remove_unreachable(cfg_t* cfg) {
+    int kept = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        if (b->rpo >= 0) {
+            cfg->blocks[kept] = b;
+            b->id = kept++;
+            continue;
+        }
+        while (b->nsuccs) cfg_remove_edge(b, b->succs[0]);
+        while (b->npreds) cfg_remove_edge(b->preds[0], b);
+    }
+    if (kept == cfg->nblocks) return;
+    cfg->nblocks = kept;
+    cfg_analyze(cfg);
+}
+
+
+void cfg_insert_at_start(bb_t* b, ir_instr_t* i) {
+    ir_instr_t* prev = NULL;
+    ir_instr_t* cur = b->first;
+    while (cur && (cur->op == IR_LABEL || cur->op == IR_PHI)) {
+        prev = cur;
+        cur = cur->next;
+    }
+    i->next = cur;
+    if (prev) prev->next = i;
+    else b->first = i;
+    if (!cur) b->last = i;
+}
+
+
+void cfg_insert_at_end(bb_t* b, ir_instr_t* i) {
+    ir_instr_t* last = b->last;
+    if (!last || !(ir_is_cond_branch(last->op) || ir_is_unconditional_jump(last->op))) {
+        append_instr(b, i);
+        return;
+    }
+    ir_instr_t* prev = NULL;
+    for (ir_instr_t* p = b->first; p != last; p = p->next) prev = p;
+    i->next = last;
+    if (prev) prev->next = i;
+    else b->first = i;
+}
+
+
+// Label name -> block, keyed by the interned name pointer
+typedef struct {
+    char** keys;
+    bb_t** vals;
+    int cap;
+} label_map_t;
+
+
+static unsigned hash_ptr(const void* p) {
+    unsigned long long v = (unsigned long long)(size_t)p;
+    v ^= v >> 17;
+    v *= 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(v >> 32);
+}
+
+
+static void map_put(label_map_t* m, char* key, bb_t* b) {
+    int slot = hash_ptr(key) & (m->cap - 1);
+    while (m->keys[slot] && m->keys[slot] != key) slot = (slot + 1) & (m->cap - 1);
+    m->keys[slot] = key;
+    m->vals[slot] = b;
+}
+
+
+static bb_t* map_get(label_map_t* m, char* key) {
+    int slot = hash_ptr(key) & (m->cap - 1);
+    while (m->keys[slot]) {
+        if (m->keys[slot] == key) return m->vals[slot];
+        slot = (slot + 1) & (m->cap - 1);
+    }
+    return NULL;
+}
+
+
+cfg_t* build_cfg(ir_func_t* f) {
+    cfg_t* cfg = calloc(1, sizeof(cfg_t));
+    cfg->func = f;
+    cfg->arena = arena_create();
+
+    // Entry block never starts with a label so that nothing can branch back to it
+    bb_t* cur = alloc_block(cfg);
+    int nlabels = 0;
+
+    ir_instr_t* i = f->body;
+    while (i) {
+        ir_instr_t* next = i->next;
+        if (i->op == IR_LABEL) {
+            if (!cur || cur->first || cur == cfg->blocks[0]) cur = alloc_block(cfg);
+            cur->label = i->dest;
+            nlabels++;
+        } else if (!cur) {  // Code right after a terminator: give it a block and label of its own
+            cur = alloc_block(cfg);
+            cur->label = new_label(f);
+            append_instr(cur, new_ir(f, IR_LABEL, cur->label, NULL, NULL, 0));
+            nlabels++;
+        }
+        append_instr(cur, i);
+        if (ir_is_cond_branch(i->op) || ir_is_unconditional_jump(i->op)) cur = NULL;
+        i = next;
+    }
+    f->body = NULL;  // The blocks own the instructions until linearize_cfg
+
+    label_map_t map;
+    map.cap = 16;
+    while (map.cap < nlabels * 2) map.cap *= 2;
+    map.keys = arena_alloc(cfg->arena, map.cap * sizeof(char*));
+    map.vals = arena_alloc(cfg->arena, map.cap * sizeof(bb_t*));
+    for (int k = 0; k < cfg->nblocks; k++) {
+        if (cfg->blocks[k]->label) map_put(&map, cfg->blocks[k]->label, cfg->blocks[k]);
+    }
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        bb_t* fall = (k + 1 < cfg->nblocks) ? cfg->blocks[k + 1] : NULL;
+        ir_instr_t* last = b->last;
+
+        if (last && (ir_is_cond_branch(last->op) || last->op == IR_J)) {
+            bb_t* target = map_get(&map, last->dest);
+            if (!target) {
+                fprintf(stderr, "IR error: branch to unknown label '%s' in %s\n", last->dest, f->name);
+                exit(1);
+            }
+            if (last->op == IR_J) {
+                cfg_add_edge(cfg, b, target);
+                continue;
+            }
+            if (target == fall) {  // Branch to the next block either way: drop it
+                ir_instr_t* prev = NULL;
+                for (ir_instr_t* p = b->first; p != last; p = p->next) prev = p;
+                if (prev) prev->next = NULL;
+                else b->first = NULL;
+                b->last = prev;
+            } else {
+                cfg_add_edge(cfg, b, target);
+                if (fall) cfg_add_edge(cfg, b, fall);
+                continue;
+            }
+        }
+        if (last && last->op == IR_JR) continue;  // Return: leaves the function
+        if (fall) cfg_add_edge(cfg, b, fall);
+    }
+
+    cfg_analyze(cfg);
+    return cfg;
+}
+
+
+static void compute_rpo(cfg_t* cfg) {
+    for (int k = 0; k < cfg->nblocks; k++) cfg->blocks[k]->rpo = -1;
+
+    bb_t** stack = malloc(cfg->nblocks * sizeof(bb_t*));
+    int* edge = malloc(cfg->nblocks * sizeof(int));
+    char* seen = calloc(cfg->nblocks, 1);
+    bb_t** post = malloc(cfg->nblocks * sizeof(bb_t*));
+    int npost = 0;
+    int sp = 0;
+
+    stack[sp] = cfg->blocks[0];
+    edge[sp++] = 0;
+    seen[0] = 1;
+    while (sp) {
+        bb_t* b = stack[sp - 1];
+        if (edge[sp - 1] < b->nsuccs) {
+            bb_t* s = b->succs[edge[sp - 1]++];
+            if (!seen[s->id]) {
+                seen[s->id] = 1;
+                stack[sp] = s;
+                edge[sp++] = 0;
+            }
+        } else {
+            post[npost++] = b;
+            sp--;
+        }
+    }
+
+    cfg->rpo = arena_alloc(cfg->arena, (npost ? npost : 1) * sizeof(bb_t*));
+    cfg->nrpo = npost;
+    for (int k = 0; k < npost; k++) {
+        cfg->rpo[k] = post[npost - 1 - k];
+        cfg->rpo[k]->rpo = k;
+    }
+
+    free(stack);
+    free(edge);
+    free(seen);
+    free(post);
+}
+
+
+static bb_t* intersect(bb_t* a, bb_t* b) {
+    while (a != b) {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+static void compute_dominators(cfg_t* cfg) {
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        b->idom = NULL;
+        b->dom_child = NULL;
+        b->dom_sibling = NULL;
+    }
+    bb_t* entry = cfg->rpo[0];
+    entry->idom = entry;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int k = 1; k < cfg->nrpo; k++) {
+            bb_t* b = cfg->rpo[k];
+            bb_t* new_idom = NULL;
+            for (int p = 0; p < b->npreds; p++) {
+                bb_t* pred = b->preds[p];
+                if (pred->rpo < 0 || !pred->idom) continue;
+                new_idom = new_idom ? intersect(pred, new_idom) : pred;
+            }
+            if (new_idom != b->idom) {
+                b->idom = new_idom;
+                changed = 1;
+            }
+        }
+    }
+    entry->idom = NULL;
+
+    // Children in reverse RPO order so that the tree lists them in RPO order
+    for (int k = cfg->nrpo - 1; k >= 1; k--) {
+        bb_t* b = cfg->rpo[k];
+        b->dom_sibling = b->idom->dom_child;
+        b->idom->dom_child = b;
+    }
+
+    // Pre/post numbering of the dominator tree for O(1) dominance queries
+    bb_t** stack = malloc((cfg->nrpo + 1) * sizeof(bb_t*));
+    int sp = 0;
+    int counter = 0;
+    stack[sp++] = entry;
+    entry->dom_pre = counter++;
+    bb_t** next_child = malloc(cfg->nblocks * sizeof(bb_t*));
+    next_child[entry->id] = entry->dom_child;
+    while (sp) {
+        bb_t* b = stack[sp - 1];
+        bb_t* c = next_child[b->id];
+        if (c) {
+            next_child[b->id] = c->dom_sibling;
+            c->dom_pre = counter++;
+            next_child[c->id] = c->dom_child;
+            stack[sp++] = c;
+        } else {
+            b->dom_post = counter++;
+            sp--;
+        }
+    }
+    free(stack);
+    free(next_child);
+}
+
+
+int cfg_vreg_limit(cfg_t* cfg) {
+    int limit = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id >= limit) limit = id + 1;
+            }
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (id >= limit) limit = id + 1;
+            for (int a = 0; a < i->nargs; a++) {
+                id = ir_vreg_id(i->args[a]);
+                if (id >= limit) limit = id + 1;
+            }
+        }
+    }
+    return limit;
+}
+
+
+int cfg_dominates(bb_t* a, bb_t* b) {
+    return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+
+static int cmp_loop_size_desc(const void* x, const void* y) {
+    const loop_t* a = *(loop_t* const*)x;
+    const loop_t* b = *(loop_t* const*)y;
+    return b->nblocks - a->nblocks;
+}
+
+
+static void compute_loops(cfg_t* cfg) {
+    cfg->nloops = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        cfg->blocks[k]->loop = NULL;
+        cfg->blocks[k]->loop_depth = 0;
+    }
+
+    loop_t** loops = malloc((cfg->nrpo + 1) * sizeof(loop_t*));
+    int nloops = 0;
+    int* mark = malloc(cfg->nblocks * sizeof(int));
+    for (int k = 0; k < cfg->nblocks; k++) mark[k] = -1;
+    bb_t** work = malloc(cfg->nblocks * sizeof(bb_t*));
+    bb_t** body = malloc(cfg->nblocks * sizeof(bb_t*));
+
+    for (int k = 0; k < cfg->nrpo; k++) {
+        bb_t* h = cfg->rpo[k];
+        int nbody = 0;
+        int wn = 0;
+        for (int p = 0; p < h->npreds; p++) {
+            bb_t* latch = h->preds[p];
+            if (latch->rpo < 0 || !cfg_dominates(h, latch)) continue;  // Not a back edge
+            if (nbody == 0) {
+                mark[h->id] = nloops;
+                body[nbody++] = h;
+            }
+            if (mark[latch->id] != nloops) {
+                mark[latch->id] = nloops;
+                body[nbody++] = latch;
+                work[wn++] = latch;
+            }
+        }
+        while (wn) {
+            bb_t* b = work[--wn];
+            for (int p = 0; p < b->npreds; p++) {
+                bb_t* pred = b->preds[p];
+                if (pred->rpo < 0 || mark[pred->id] == nloops) continue;
+                mark[pred->id] = nloops;
+                body[nbody++] = pred;
+                work[wn++] = pred;
+            }
+        }
+        if (nbody == 0) continue;
+
+        loop_t* l = arena_alloc(cfg->arena, sizeof(loop_t));
+        l->header = h;
+        l->nblocks = nbody;
+        l->blocks = arena_alloc(cfg->arena, nbody * sizeof(bb_t*));
+        memcpy(l->blocks, body, nbody * sizeof(bb_t*));
+        loops[nloops++] = l;
+    }
+
+    // Outermost first: each block ends up pointing at its innermost loop
+    qsort(loops, nloops, sizeof(loop_t*), cmp_loop_size_desc);
+    for (int k = 0; k < nloops; k++) {
+        loop_t* l = loops[k];
+        l->parent = l->header->loop;
+        l->depth = l->parent ? l->parent->depth + 1 : 1;
+        for (int b = 0; b < l->nblocks; b++) {
+            l->blocks[b]->loop = l;
+            l->blocks[b]->loop_depth = l->depth;
+        }
+    }
+
+    cfg->loops = arena_alloc(cfg->arena, (nloops ? nloops : 1) * sizeof(loop_t*));
+    for (int k = 0; k < nloops; k++) cfg->loops[k] = loops[nloops - 1 - k];
+    cfg->nloops = nloops;
+
+    free(loops);
+    free(mark);
+    free(work);
+    free(body);
+}
+
+
+void cfg_analyze(cfg_t* cfg) {
+    compute_rpo(cfg);
+    compute_dominators(cfg);
+    compute_loops(cfg);
+}
+
+
+static bb_t* fallthrough_succ(bb_t* b) {
+    ir_instr_t* last = b->last;
+    if (last && ir_is_cond_branch(last->op)) return b->nsuccs == 2 ? b->succs[1] : NULL;
+    if (last && ir_is_unconditional_jump(last->op)) return NULL;
+    return b->nsuccs == 1 ? b->succs[0] : NULL;
+}
+
+
+// k-th successor of v in the reverse CFG, -1 past the end
+static int rsucc(pdom_t* pd, int v, int k) {
+    if (v != pd->exit) return k < pd->cfg->blocks[v]->npreds ? pd->cfg->blocks[v]->preds[k]->id : -1;
+    return k < pd->nexit ? pd->exit_list[k] : -1;
+}
+
+
+// Iterative DFS over the reverse CFG from the exit, numbering nodes in postorder
+static void reverse_dfs(pdom_t* pd, char* seen, int* stack, int* next) {
+    int sp = 0;
+    stack[sp] = pd->exit;
+    next[sp++] = 0;
+    seen[pd->exit] = 1;
+    while (sp) {
+        int v = stack[sp - 1];
+        int w = rsucc(pd, v, next[sp - 1]++);
+        if (w < 0) {
+            pd->po[v] = pd->norder;
+            pd->order[pd->norder++] = v;
+            sp--;
+        } else if (!seen[w]) {
+            seen[w] = 1;
+            stack[sp] = w;
+            next[sp++] = 0;
+        }
+    }
+}
+
+
+int pdom_intersect(pdom_t* pd, int a, int b) {
+    while (a != b) {
+        while (pd->po[a] < pd->po[b]) a = pd->ipdom[a];
+        while (pd->po[b] < pd->po[a]) b = pd->ipdom[b];
+    }
+    return a;
+}
+
+
+void compute_postdominators(pdom_t* pd) {
+    cfg_t* cfg = pd->cfg;
+    int n = cfg->nblocks + 1;
+    pd->exit = cfg->nblocks;
+    pd->exit_pred = calloc(n, 1);
+    pd->ipdom = malloc(n * sizeof(int));
+    pd->po = malloc(n * sizeof(int));
+    pd->order = malloc(n * sizeof(int));
+    pd->exit_list = malloc(n * sizeof(int));
+    pd->nexit = 0;
+    pd->norder = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        pd->exit_pred[k] = cfg->blocks[k]->nsuccs == 0;
+        if (pd->exit_pred[k]) pd->exit_list[pd->nexit++] = k;
+    }
+
+    // Blocks the first walk misses cannot reach a return: hook the latest of them to the exit and retry
+    char* seen = calloc(n, 1);
+    int* stack = malloc(n * sizeof(int));
+    int* next = malloc(n * sizeof(int));
+    for (;;) {
+        memset(seen, 0, n);
+        pd->norder = 0;
+        reverse_dfs(pd, seen, stack, next);
+        int missing = -1;
+        for (int k = cfg->nblocks - 1; k >= 0 && missing < 0; k--) {
+            if (!seen[k]) missing = k;
+        }
+        if (missing < 0) break;
+        pd->exit_pred[missing] = 1;
+        pd->exit_list[pd->nexit++] = missing;
+    }
+    free(seen);
+    free(stack);
+    free(next);
+
+    for (int k = 0; k < n; k++) pd->ipdom[k] = -1;
+    pd->ipdom[pd->exit] = pd->exit;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int o = pd->norder - 2; o >= 0; o--) {  // Reverse postorder, skipping the exit
+            int v = pd->order[o];
+            bb_t* b = cfg->blocks[v];
+            int new_idom = pd->exit_pred[v] ? pd->exit : -1;
+            for (int s = 0; s < b->nsuccs; s++) {
+                int w = b->succs[s]->id;
+                if (pd->ipdom[w] < 0) continue;
+                new_idom = new_idom < 0 ? w : pdom_intersect(pd, w, new_idom);
+            }
+            if (new_idom != pd->ipdom[v]) {
+                pd->ipdom[v] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+}
+
+
+void free_postdominators(pdom_t* pd) {
+    free(pd->exit_pred);
+    free(pd->exit_list);
+    free(pd->ipdom);
+    free(pd->po);
+    free(pd->order);
+}
+
+
+void linearize_cfg(cfg_t* cfg) {
+    ir_func_t* f = cfg->func;
+    ir_instr_t* head = NULL;
+    ir_instr_t* tail = NULL;
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        bb_t* next = (k + 1 < cfg->nblocks) ? cfg->blocks[k + 1] : NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* n = i->next;
+            int jump_to_next = i == b->last && i->op == IR_J && b->nsuccs == 1 && b->succs[0] == next;
+            if (!jump_to_next) append_ir(&head, &tail, i);
+            i = n;
+        }
+        bb_t* fall = fallthrough_succ(b);
+        if (fall && fall != next) append_ir(&head, &tail, new_ir(f, IR_J, fall->label, NULL, NULL, 0));
+    }
+    if (tail) tail->next = NULL;
+    f->body = head;
+}
+
+
+void free_cfg(cfg_t* cfg) {
+    arena_destroy(cfg->arena);
+    free(cfg);
+}
+
+
+void print_cfg(cfg_t* cfg, FILE* out) {
+    fprintf(out, "%s:\n", cfg->func->name);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        fprintf(out, "  B%d", b->id);
+        if (b->label) fprintf(out, " (%s)", b->label);
+        if (b->rpo < 0) {
+            fprintf(out, " unreachable");
+        } else {
+            fprintf(out, " rpo=%d", b->rpo);
+            if (b->idom) fprintf(out, " idom=B%d", b->idom->id);
+            if (b->loop_depth) fprintf(out, " loop=B%d depth=%d", b->loop->header->id, b->loop_depth);
+        }
+        fprintf(out, "\n    preds:");
+        for (int p = 0; p < b->npreds; p++) fprintf(out, " B%d", b->preds[p]->id);
+        fprintf(out, "\n    succs:");
+        for (int s = 0; s < b->nsuccs; s++) fprintf(out, " B%d", b->succs[s]->id);
+        fprintf(out, "\n");
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            fprintf(out, "    ");
+            print_ir_instr(i, out);
+        }
+    }
+    for (int k = 0; k < cfg->nloops; k++) {
+        loop_t* l = cfg->loops[k];
+        fprintf(out, "  loop header=B%d depth=%d blocks:", l->header->id, l->depth);
+        for (int b = 0; b < l->nblocks; b++) fprintf(out, " B%d", l->blocks[b]->id);
+        fprintf(out, "\n");
+    }
+}
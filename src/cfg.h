@@ -0,0 +1,134 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "IR.h"
+
+
+typedef struct loop loop_t;
+
+
+// Basic block: a straight-line run of instructions entered only at the top
+typedef struct bb {
+    int id;  // Index in cfg->blocks (layout order)
+    char* label;  // Name of the leading IR_LABEL (NULL only for the entry block)
+    ir_instr_t* first;  // Instructions of the block, last->next == NULL while the CFG exists
+    ir_instr_t* last;
+
+    // Edges. For a conditional branch succs[0] is the taken target and succs[1] the fall-through
+    struct bb** succs;
+    int nsuccs;
+    int succs_cap;
+    struct bb** preds;
+    int npreds;
+    int preds_cap;
+
+    int rpo;  // Reverse-postorder number, -1 if unreachable from the entry
+    struct bb* idom;  // Immediate dominator (NULL for the entry and unreachable blocks)
+    struct bb* dom_child;  // First child in the dominator tree
+    struct bb* dom_sibling;  // Next child of idom
+    int dom_pre;  // Dominator tree pre/post numbers: a dominates b iff a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post
+    int dom_post;
+
+    loop_t* loop;  // Innermost natural loop containing the block (NULL if none)
+    int loop_depth;
+} bb_t;
+
+
+// Natural loop: header plus every block that reaches a back edge to it without passing the header
+struct loop {
+    bb_t* header;
+    bb_t** blocks;  // Includes the header
+    int nblocks;
+    loop_t* parent;  // Enclosing loop (NULL for outermost)
+    int depth;  // 1 for outermost loops
+};
+
+
+typedef struct cfg {
+    ir_func_t* func;
+    arena_t* arena;  // Blocks, edge arrays and loop info (instructions stay in the function's arena)
+    bb_t** blocks;  // Layout order; blocks[0] is the entry
+    int nblocks;
+    int blocks_cap;
+    bb_t** rpo;  // Reachable blocks in reverse postorder
+    int nrpo;
+    loop_t** loops;  // Innermost loops first
+    int nloops;
+} cfg_t;
+
+
+// Split f->body into basic blocks and compute RPO, dominators and loops
+cfg_t* build_cfg(ir_func_t* f);
+
+
+// Recompute RPO, dominator tree and loops after passes changed edges
+void cfg_analyze(cfg_t* cfg);
+
+
+// Edge maintenance for passes that restructure control flow
+void cfg_add_edge(cfg_t* cfg, bb_t* from, bb_t* to);
+void cfg_remove_edge(bb_t* from, bb_t* to);
+int cfg_pred_index(bb_t* b, bb_t* pred);
+
+
+// Point the edge from -> to at new_to instead, keeping its position in from's successors and retargeting
+// the branch or jump that takes it (a fall-through edge gets its jump when linearized)
+void cfg_redirect_edge(cfg_t* cfg, bb_t* from, bb_t* to, bb_t* new_to);
+
+
+// Append a new empty block (with a fresh label) to the layout
+bb_t* cfg_new_block(cfg_t* cfg);
+
+
+// Put a new block on the edge from -> to, keeping the edge's position in both edge lists (renumbers ids)
+bb_t* cfg_split_edge(cfg_t* cfg, bb_t* from, bb_t* to);
+
+
+// Drop blocks not reachable from the entry (renumbers ids and reanalyzes)
+void cfg_remove_unreachable(cfg_t* cfg);
+
+
+// Insert i after the block's label and phis / before its terminating branch or jump
+void cfg_insert_at_start(bb_t* b, ir_instr_t* i);
+void cfg_insert_at_end(bb_t* b, ir_instr_t* i);
+
+
+// One past the highest virtual register id mentioned in the function (size for vreg-indexed arrays)
+int cfg_vreg_limit(cfg_t* cfg);
+
+
+// Does a dominate b? (both reachable)
+int cfg_dominates(bb_t* a, bb_t* b);
+
+
+// Postdominators are dominators of the reverse CFG rooted at a virtual exit node (index nblocks).
+// Blocks that return feed the exit; so does one block of every loop that can never leave the function
+typedef struct {
+    cfg_t* cfg;
+    int exit;
+    char* exit_pred;  // Block has a (real or virtual) edge to the exit
+    int* exit_list;  // The blocks with exit_pred set
+    int nexit;
+    int* ipdom;  // Immediate postdominator, -1 if not computed
+    int* po;  // Postorder number in the reverse CFG
+    int* order;  // Nodes by postorder number
+    int norder;
+} pdom_t;
+
+void compute_postdominators(pdom_t* pd);  // pd->cfg set by the caller
+int pdom_intersect(pdom_t* pd, int a, int b);  // Nearest common postdominator of blocks a and b
+void free_postdominators(pdom_t* pd);
+
+
+// Chain the blocks back into f->body in layout order, adding jumps where fall-through was broken
+// and dropping jumps to the block that follows anyway
+void linearize_cfg(cfg_t* cfg);
+
+
+void free_cfg(cfg_t* cfg);
+
+
+// Debug view (--dump-cfg)
+void print_cfg(cfg_t* cfg, FILE* out);
+
+#endif
@@ -2,52 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include "codegen.h"
+#include "frame.h"
+#include "sched.h"
 
 
-static int type_size(type_t* t) {
-    if (!t) return 0;
-
-    switch (t->kind) {
-        case TYPE_INT:
-        case TYPE_BOOL:
-        case TYPE_CHAR:
-        case TYPE_UINT:
-        case TYPE_POINTER: return 4;
-        case TYPE_ARRAY: return t->size * type_size(t->subtype);
-        case TYPE_STRUCT: {
-            int size = 0;
-            for (param_t* f = t->params; f; f = f->next) {
-                size += type_size(f->type);
-            }
-            return size;
-        }
-        default: return 4;
-    }
-}
-
-
-static int count_locals(stmt_t* s) {
-    int count = 0;
-    for (stmt_t* cur = s; cur; cur = cur->next_stmt) {
-        switch (cur->kind) {
-            case STMT_DECL: count += type_size(cur->decl->type); break;
-            case STMT_IF:
-                count += count_locals(cur->body);
-                if (cur->else_body) count += count_locals(cur->else_body);
-                break;
-            case STMT_WHILE: count += count_locals(cur->body); break;
-            case STMT_BLOCK: count += count_locals(cur->body); break;
-            default: break;  // No locals in assign/return
-        }
-    }
-    return count;
-}
-
-
-static void gen_globals(decl_t* globals, FILE* out) {  // types & structs are not stored
+static void gen_globals(ir_program_t* ir, FILE* out) {  // types & structs are not stored
     fprintf(out, ".data\n");  // Start data section
-    for (decl_t* g = globals; g; g = g->next) {
-        if (g->kind == DECL_VAR) {
+    for (decl_t* g = ir->globals; g; g = g->next) {
+        if (g->kind == DECL_VAR && !ir_global_is_dead(ir, g->name)) {
             fprintf(out, "%s: .word ", g->name);  // Label
             if (g->value) {
                 fprintf(out, "%d\n", g->value->num_val);  // Assume simple int init for now
@@ -59,23 +21,49 @@ static void gen_globals(decl_t* globals, FILE* out) {  // types & structs are no
 }
 
 
+// Frame layout is in frame.h
 static void gen_prologue(ir_func_t* f, FILE* out) {
-    int frame_size = 8 + count_locals(f->ast->code);  // ra + fp + locals
-    frame_size = (frame_size + 3) & ~3;  // Cool trick to align to 4 bytes
-    fprintf(out, "addiu $sp, $sp, -%d\n", frame_size);  // Alloc frame
-    fprintf(out, "sw $ra, %d($sp)\n", frame_size - 4);  // Save ra
-    fprintf(out, "sw $fp, %d($sp)\n", frame_size - 8);  // Save fp
-    fprintf(out, "move $fp, $sp\n");  // Set fp
+    int size = f->frame_size;
+    if (size == 0) return;  // Leaf that fits in registers
+    fprintf(out, "addiu $sp, $sp, -%d\n", size);  // Alloc frame
+    int offset = size;
+    if (!f->is_leaf) {
+        fprintf(out, "sw $ra, %d($sp)\n", size - 4);  // Save ra
+        fprintf(out, "sw $fp, %d($sp)\n", size - 8);  // Save fp
+        offset -= 8;
+    }
+    for (int k = 0; k < 8; k++) {  // Callee-saved registers the body writes
+        if (f->saved_regs & (1u << k)) fprintf(out, "sw $s%d, %d($sp)\n", k, offset -= 4);
+    }
+    if (!f->is_leaf) fprintf(out, "addiu $fp, $sp, %d\n", size);  // fp = caller's sp, stack parameters above it
+    for (ir_var_t* v = f->vars; v; v = v->next) {  // Register parameters the body reads from memory
+        if (v->is_param && v->param_index < NUM_ARG_REGS && v->offset >= 0) {
+            fprintf(out, "sw $a%d, %d($sp)\n", v->param_index, v->offset);
+        }
+    }
+}
+
+
+// Restore what the prologue saved and release the frame (unless the return's delay slot does)
+static void gen_restore(ir_func_t* f, FILE* out, int release) {
+    int size = f->frame_size;
+    int offset = f->is_leaf ? size : size - 8;
+    for (int k = 0; k < 8; k++) {
+        if (f->saved_regs & (1u << k)) fprintf(out, "lw $s%d, %d($sp)\n", k, offset -= 4);
+    }
+    if (!f->is_leaf) {
+        fprintf(out, "lw $ra, %d($sp)\n", size - 4);  // Restore ra
+        fprintf(out, "lw $fp, %d($sp)\n", size - 8);  // Restore fp
+    }
+    if (size && release) fprintf(out, "addiu $sp, $sp, %d\n", size);  // Dealloc
 }
 
 
 static void gen_epilogue(ir_func_t* f, FILE* out) {
-    int frame_size = 8 + count_locals(f->ast->code);  // Match prologue
-    frame_size = (frame_size + 3) & ~3;
-    fprintf(out, "lw $ra, %d($sp)\n", frame_size - 4);  // Restore ra
-    fprintf(out, "lw $fp, %d($sp)\n", frame_size - 8);  // Restore fp
-    fprintf(out, "addiu $sp, $sp, %d\n", frame_size);  // Dealloc
+    gen_restore(f, out, 0);
     fprintf(out, "jr $ra\n");  // Return
+    if (f->frame_size) fprintf(out, "addiu $sp, $sp, %d\n", f->frame_size);  // Dealloc in the delay slot
+    else fprintf(out, "nop\n");
 }
 
 
@@ -255,16 +243,55 @@ static void gen_instr(ir_instr_t* i, FILE* out) {
 }
 
 
-void gen_code(ir_program_t* ir, FILE* out) {
-    gen_globals(ir->globals, out);
+// Does a return reach the epilogue without a jump? Only labels may follow its delay slot, then the last
+// return of the function with an empty one
+static int falls_into_epilogue(ir_instr_t* ret) {
+    ir_instr_t* i = ret->next->next;
+    while (i && i->op == IR_LABEL) i = i->next;
+    return i && i->op == IR_JR && strcmp(i->src1, "$ra") == 0 && !i->imm && i->next->op == IR_NOP && !i->next->next;
+}
+
+
+void gen_code(ir_program_t* ir, FILE* out, regalloc_kind_t regalloc, int optimize) {
+    gen_globals(ir, out);
     fprintf(out, ".text\n");
 
     for (ir_func_t* f = ir->functions; f; f = f->next) {
+        layout_frame(f);  // Locals and parameters become $sp/$fp offsets
+        allocate_registers(f, regalloc);  // Only real register names from here on
+        finish_frame(f);
+        schedule_func(f, optimize);  // Every branch, jump and call gets its delay slot
         fprintf(out, "%s:\n", f->name);
-        gen_prologue(f, out);
+        if (!f->save_point) gen_prologue(f, out);
+        int early_return = 0;  // Returns before the end jump to the shared epilogue
+        int frame_return = 0;  // Some return goes through the epilogue at all
+        for (ir_instr_t* i = f->body; i; i = i->next) {
+            if (i->op == IR_JR && strcmp(i->src1, "$ra") == 0 && !i->imm) {
+                frame_return = 1;
+                if (i->next->next && !falls_into_epilogue(i)) early_return = 1;  // Past its delay slot
+            }
+        }
         for (ir_instr_t* i = f->body; i; i = i->next) {
-            gen_instr(i, out);
+            if (i->op == IR_JR && strcmp(i->src1, "$ra") == 0 && !i->imm && !i->next->next) {
+                // The last one falls into the epilogue: its delay slot runs first, unless it is empty
+                if (i->next->op != IR_NOP) gen_instr(i->next, out);
+                break;
+            }
+            if (i->op == IR_JR && strcmp(i->src1, "$ra") == 0 && !i->imm && falls_into_epilogue(i)) {
+                if (i->next->op != IR_NOP) gen_instr(i->next, out);  // No jump: just what its delay slot did
+                i = i->next;
+                continue;
+            }
+            if (i->op == IR_JR && strcmp(i->src1, "$ra") == 0 && !i->imm) {
+                fprintf(out, "j %s_epilogue\n", f->name);
+                continue;
+            }
+            gen_instr(i, out);  // A return without a frame has nothing to undo: plain jr $ra
+            if (i == f->save_point) gen_prologue(f, out);  // Shrink-wrapped: only paths that need the frame
+            if (i == f->restore_point) gen_restore(f, out, 1);
         }
-        gen_epilogue(f, out);
+        if (early_return) fprintf(out, "%s_epilogue:\n", f->name);
+        if (frame_return) gen_epilogue(f, out);
+        free_ir_func(f);  // Assembly is out; the function's IR is no longer needed
     }
 }
@@ -2,7 +2,9 @@
 #define CODEGEN_H
 
 #include "IR.h"
+#include "regalloc.h"
 
-void gen_code(ir_program_t* ir, FILE* out);
+// optimize: schedule blocks and fill delay slots (nops only otherwise)
+void gen_code(ir_program_t* ir, FILE* out, regalloc_kind_t regalloc, int optimize);
 
 #endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "copyprop.h"
+
+
+static char* resolve(char** repl, int limit, char* name) {
+    int id;
+    while ((id = ir_vreg_id(name)) >= 0 && id < limit && repl[id]) name = repl[id];
+    return name;
+}
+
+
+// The single value a phi merges, ignoring references to itself (NULL if there are several)
+static char* trivial_phi_value(char** repl, int limit, ir_instr_t* phi) {
+    char* value = NULL;
+    for (int a = 0; a < phi->nargs; a++) {
+        char* arg = resolve(repl, limit, phi->args[a]);
+        if (arg == phi->dest || arg == value) continue;
+        if (value) return NULL;
+        value = arg;
+    }
+    return value;
+}
+
+
+static int is_copy_source(const char* name) {
+    return name && (ir_vreg_id(name) >= 0 || strcmp(name, "$zero") == 0);  // Other physical registers get clobbered
+}
+
+
+// The register an instruction merely copies: moves, and arithmetic with a neutral $zero or 0 operand
+static char* copied_register(ir_instr_t* i) {
+    int zero1 = i->src1 && strcmp(i->src1, "$zero") == 0;
+    int zero2 = i->src2 && strcmp(i->src2, "$zero") == 0;
+    switch (i->op) {
+        case IR_MOVE: return i->src1;
+        case IR_ADD: case IR_ADDU: case IR_OR: case IR_XOR:
+            return zero2 ? i->src1 : zero1 ? i->src2 : NULL;
+        case IR_SUB: case IR_SUBU:
+            return zero2 ? i->src1 : NULL;
+        case IR_ADDI: case IR_ADDIU: case IR_ORI: case IR_XORI: case IR_SRL:
+            return i->imm == 0 ? i->src1 : NULL;
+        default: return NULL;
+    }
+}
+
+
+int copyprop(cfg_t* cfg) {
+    int limit = cfg_vreg_limit(cfg);
+    char** repl = calloc(limit ? limit : 1, sizeof(char*));
+
+    int changed = 1;
+    while (changed) {  // Removing one phi can make another trivial
+        changed = 0;
+        for (int k = 0; k < cfg->nblocks; k++) {
+            for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+                char* copied = i->op == IR_PHI ? NULL : copied_register(i);
+                if (!copied && i->op != IR_PHI) continue;
+                int id = ir_vreg_id(i->dest);
+                if (id < 0 || repl[id]) continue;
+                char* value = NULL;
+                if (is_copy_source(copied)) value = resolve(repl, limit, copied);
+                else if (i->op == IR_PHI) value = trivial_phi_value(repl, limit, i);
+                if (!value || value == i->dest) continue;
+                repl[id] = value;
+                changed = 1;
+            }
+        }
+    }
+
+    int removed = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            int id = (i->op == IR_PHI || copied_register(i)) ? ir_vreg_id(i->dest) : -1;
+            if (id >= 0 && repl[id]) {
+                if (prev) prev->next = next;
+                else b->first = next;
+                if (b->last == i) b->last = prev;
+                removed++;
+                i = next;
+                continue;
+            }
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) *slots[s] = resolve(repl, limit, *slots[s]);
+            for (int a = 0; a < i->nargs; a++) i->args[a] = resolve(repl, limit, i->args[a]);
+            prev = i;
+            i = next;
+        }
+    }
+    free(repl);
+    return removed;
+}
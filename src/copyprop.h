@@ -0,0 +1,12 @@
+#ifndef COPYPROP_H
+#define COPYPROP_H
+
+#include "cfg.h"
+
+
+// Copy propagation over SSA: uses of `move d, s` (s a virtual register or $zero) read s directly and the
+// move goes, as do copies in disguise like `add d, s, $zero`. Phis whose operands are all the same
+// value (or the phi itself) are removed the same way. Returns the number of instructions removed
+int copyprop(cfg_t* cfg);
+
+#endif
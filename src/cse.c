@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cse.h"
+#include "ssa.h"
+
+
+// Longest run of stores searched for one that could have changed a load's word
+#define MAX_STORES_SEARCHED 32
+
+
+// An expression: opcode plus canonical operands. Loads also carry the memory state they read
+typedef struct vn_entry {
+    ir_op_t op;
+    char* a;
+    char* b;
+    int imm;
+    int epoch;
+    const mem_tag_t* mem;  // Loads: alias class of the word
+    char* leader;  // Register holding the value
+    struct vn_entry* next;  // Hash chain
+    int bucket;
+} vn_entry_t;
+
+
+// A memory write on the walk's current dominator path: a store, or a call or block entry that may
+// have written anything (barrier)
+typedef struct {
+    int epoch;  // Memory state it begins
+    int barrier;
+    char* base;
+    int imm;
+    const mem_tag_t* mem;
+} mem_event_t;
+
+
+typedef struct {
+    cfg_t* cfg;
+    ssa_info_t* info;
+    char** repl;  // repl[id]: register that replaces vreg id (NULL if kept)
+    vn_entry_t** buckets;
+    int nbuckets;  // Power of two
+    vn_entry_t** scope;  // Entries in insertion order, popped when leaving a dominator subtree
+    int nscope;
+    int scope_cap;
+    int epoch;  // Current memory state; bumped by every store or call
+    int next_epoch;
+    mem_event_t* log;  // Writes in walk order, popped with the scopes
+    int nlog;
+    int log_cap;
+    int dominator_scoped;
+    char* zero;
+    int removed;
+    int loads_removed;
+} cse_state_t;
+
+
+// Current name of a register operand (after earlier replacements), looking through SSA copies
+static char* canon(cse_state_t* st, char* name) {
+    for (;;) {
+        int id = ir_vreg_id(name);
+        if (id < 0 || id >= st->info->limit) return name;
+        if (st->repl[id]) {
+            name = st->repl[id];
+            continue;
+        }
+        ir_instr_t* d = st->info->defs[id].instr;
+        if (d && d->op == IR_MOVE && ir_vreg_id(d->src1) >= 0) {
+            name = d->src1;
+            continue;
+        }
+        return name;
+    }
+}
+
+
+static int is_commutative(ir_op_t op) {
+    return op == IR_ADD || op == IR_ADDU || op == IR_AND || op == IR_OR || op == IR_XOR || op == IR_NOR || op == IR_MUL;
+}
+
+
+// Operations whose result depends only on their operands
+static int is_pure(ir_op_t op) {
+    return (op >= IR_ADDI && op <= IR_SRL) || op == IR_LI || op == IR_LA || op == IR_MUL || op == IR_DIV || op == IR_DIVU;
+}
+
+
+static unsigned hash_key(ir_op_t op, const char* a, const char* b, int imm) {
+    unsigned h = (unsigned)op * 2654435761u;
+    h ^= (unsigned)((size_t)a >> 3) * 40503u;
+    h ^= (unsigned)((size_t)b >> 3) * 9973u;
+    h ^= (unsigned)imm * 31u;
+    return h ^ (h >> 15);
+}
+
+
+// Latest entry for the expression (for a load, the latest recorded value of the word)
+static vn_entry_t* lookup(cse_state_t* st, ir_op_t op, char* a, char* b, int imm) {
+    unsigned h = hash_key(op, a, b, imm) & (st->nbuckets - 1);
+    for (vn_entry_t* e = st->buckets[h]; e; e = e->next) {
+        if (e->op == op && e->a == a && e->b == b && e->imm == imm) return e;
+    }
+    return NULL;
+}
+
+
+static void insert(cse_state_t* st, ir_op_t op, char* a, char* b, int imm, const mem_tag_t* mem, char* leader) {
+    vn_entry_t* e = arena_alloc(st->cfg->arena, sizeof(vn_entry_t));
+    e->op = op;
+    e->a = a;
+    e->b = b;
+    e->imm = imm;
+    e->epoch = st->epoch;
+    e->mem = mem;
+    e->leader = leader;
+    e->bucket = hash_key(op, a, b, imm) & (st->nbuckets - 1);
+    e->next = st->buckets[e->bucket];
+    st->buckets[e->bucket] = e;
+    if (st->nscope == st->scope_cap) {
+        st->scope_cap = st->scope_cap ? st->scope_cap * 2 : 64;
+        st->scope = realloc(st->scope, st->scope_cap * sizeof(vn_entry_t*));
+    }
+    st->scope[st->nscope++] = e;
+}
+
+
+// Start a new memory state with a store to imm(base), or with a barrier when base is NULL
+static void push_write(cse_state_t* st, char* base, int imm, const mem_tag_t* mem) {
+    st->epoch = st->next_epoch++;
+    if (st->nlog == st->log_cap) {
+        st->log_cap = st->log_cap ? st->log_cap * 2 : 64;
+        st->log = realloc(st->log, st->log_cap * sizeof(mem_event_t));
+    }
+    mem_event_t* w = &st->log[st->nlog++];
+    w->epoch = st->epoch;
+    w->barrier = base == NULL;
+    w->base = base;
+    w->imm = imm;
+    w->mem = mem;
+}
+
+
+// Does the word load entry e read still hold e's value? Stores through the same base register are told
+// apart by offset, others by alias class
+static int load_valid(cse_state_t* st, vn_entry_t* e) {
+    int seen = 0;
+    for (int k = st->nlog - 1; k >= 0 && st->log[k].epoch > e->epoch; k--) {
+        mem_event_t* w = &st->log[k];
+        if (w->barrier || ++seen > MAX_STORES_SEARCHED) return 0;
+        if (w->base == e->a ? w->imm == e->imm : ir_may_alias(w->mem, e->mem)) return 0;
+    }
+    return 1;
+}
+
+
+// Forget entries added after the scope had `height` of them (they sit at the heads of their chains)
+static void pop_scope(cse_state_t* st, int height) {
+    while (st->nscope > height) {
+        vn_entry_t* e = st->scope[--st->nscope];
+        st->buckets[e->bucket] = e->next;
+    }
+}
+
+
+static void number_block(cse_state_t* st, bb_t* b) {
+    int height = st->nscope;
+    int saved_epoch = st->epoch;
+    int saved_log = st->nlog;
+    // Memory is only known to be unchanged when the block is entered straight from its dominator
+    if (!(st->dominator_scoped && b->npreds == 1 && b->preds[0] == b->idom)) push_write(st, NULL, 0, NULL);
+
+    ir_instr_t* prev = NULL;
+    for (ir_instr_t* i = b->first; i; ) {
+        ir_instr_t* next = i->next;
+        char** slots[2];
+        int n = ir_uses(i, slots);
+        for (int s = 0; s < n; s++) {
+            int id = ir_vreg_id(*slots[s]);
+            if (id >= 0 && id < st->info->limit && st->repl[id]) *slots[s] = st->repl[id];
+        }
+
+        if (i->op == IR_SW) {  // Later loads of the word read the stored register
+            char* base = canon(st, i->src1);
+            push_write(st, base, i->imm, i->mem);
+            char* val = canon(st, i->dest);
+            if (ir_vreg_id(val) >= 0 || val == st->zero) insert(st, IR_LW, base, NULL, i->imm, i->mem, val);
+        } else if (i->op == IR_JAL || i->op == IR_JALR || i->op == IR_SYSC) {
+            push_write(st, NULL, 0, NULL);
+        }
+
+        char** d = ir_def(i);
+        int id = d ? ir_vreg_id(*d) : -1;
+        int hashable = id >= 0 && id < st->info->limit && (is_pure(i->op) || i->op == IR_LW);
+        char* a = NULL;
+        char* c = NULL;
+        if (hashable) {
+            a = i->op == IR_LA ? i->src1 : i->src1 ? canon(st, i->src1) : NULL;
+            c = i->src2 ? canon(st, i->src2) : NULL;
+            if (i->op != IR_LA && ((a && ir_vreg_id(a) < 0 && a != st->zero) || (c && ir_vreg_id(c) < 0 && c != st->zero))) hashable = 0;
+        }
+        if (hashable) {
+            if (is_commutative(i->op) && c && strcmp(a, c) > 0) {
+                char* t = a;
+                a = c;
+                c = t;
+            }
+            int imm = (i->src2 && i->op != IR_LW) ? 0 : i->imm;
+            vn_entry_t* e = lookup(st, i->op, a, c, imm);
+            if (e && i->op == IR_LW && !load_valid(st, e)) e = NULL;
+            if (e) {
+                if (i->op == IR_LW) st->loads_removed++;
+                st->repl[id] = e->leader;
+                if (prev) prev->next = next;
+                else b->first = next;
+                if (b->last == i) b->last = prev;
+                st->removed++;
+                i = next;
+                continue;
+            }
+            insert(st, i->op, a, c, imm, i->op == IR_LW ? i->mem : NULL, *d);
+        }
+        prev = i;
+        i = next;
+    }
+
+    if (st->dominator_scoped) {
+        for (bb_t* child = b->dom_child; child; child = child->dom_sibling) number_block(st, child);
+    }
+    pop_scope(st, height);
+    st->epoch = saved_epoch;
+    st->nlog = saved_log;
+}
+
+
+int cse(cfg_t* cfg, int dominator_scoped, int* loads_removed) {
+    cse_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    st.info = ssa_build_info(cfg);
+    st.repl = calloc(st.info->limit ? st.info->limit : 1, sizeof(char*));
+    st.nbuckets = 64;
+    while (st.nbuckets < st.info->limit) st.nbuckets *= 2;
+    st.buckets = calloc(st.nbuckets, sizeof(vn_entry_t*));
+    st.dominator_scoped = dominator_scoped;
+    st.next_epoch = 1;  // Entries start at memory state 0
+    st.zero = ir_intern(cfg->func, "$zero");
+
+    if (dominator_scoped) {
+        number_block(&st, cfg->blocks[0]);
+    } else {
+        for (int k = 0; k < cfg->nrpo; k++) number_block(&st, cfg->rpo[k]);
+    }
+
+    // Uses the walk reached before the replaced definition (phi operands along back edges, other blocks)
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id >= 0 && id < st.info->limit && st.repl[id]) *slots[s] = st.repl[id];
+            }
+            for (int a = 0; a < i->nargs; a++) {
+                int id = ir_vreg_id(i->args[a]);
+                if (id >= 0 && id < st.info->limit && st.repl[id]) i->args[a] = st.repl[id];
+            }
+        }
+    }
+
+    free(st.repl);
+    free(st.buckets);
+    free(st.scope);
+    free(st.log);
+    ssa_free_info(st.info);
+    *loads_removed += st.loads_removed;
+    return st.removed;
+}
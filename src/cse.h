@@ -0,0 +1,14 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "cfg.h"
+
+
+// Hash-based value numbering over SSA: an instruction computing the same pure operation as an earlier
+// one is dropped and its uses read the earlier result. A load of a word that an earlier load read or a
+// store wrote is dropped the same way, unless a call or a store that may alias it (by type-based alias
+// class, see mem_tag_t) came in between. Works within basic blocks, or across the dominator tree when
+// dominator_scoped is set. Returns the number of instructions removed; loads_removed counts the loads
+int cse(cfg_t* cfg, int dominator_scoped, int* loads_removed);
+
+#endif
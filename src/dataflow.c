@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dataflow.h"
+
+
+int bitset_words(int nbits) {
+    return (nbits + WORD_BITS - 1) / WORD_BITS;
+}
+
+
+int bit_test(const word_t* s, int k) {
+    return (s[k / WORD_BITS] >> (k % WORD_BITS)) & 1;
+}
+
+
+void bit_set(word_t* s, int k) {
+    s[k / WORD_BITS] |= (word_t)1 << (k % WORD_BITS);
+}
+
+
+void bit_clear(word_t* s, int k) {
+    s[k / WORD_BITS] &= ~((word_t)1 << (k % WORD_BITS));
+}
+
+
+sparse_set_t* sparse_set_new(int universe) {
+    sparse_set_t* s = malloc(sizeof(sparse_set_t));
+    s->dense = malloc((universe ? universe : 1) * sizeof(int));
+    s->sparse = malloc((universe ? universe : 1) * sizeof(int));  // Never needs clearing: entries are validated
+    s->n = 0;
+    s->universe = universe;
+    return s;
+}
+
+
+void sparse_set_free(sparse_set_t* s) {
+    free(s->dense);
+    free(s->sparse);
+    free(s);
+}
+
+
+int sparse_set_has(const sparse_set_t* s, int k) {
+    unsigned at = (unsigned)s->sparse[k];
+    return at < (unsigned)s->n && s->dense[at] == k;
+}
+
+
+void sparse_set_add(sparse_set_t* s, int k) {
+    if (sparse_set_has(s, k)) return;
+    s->sparse[k] = s->n;
+    s->dense[s->n++] = k;
+}
+
+
+void sparse_set_remove(sparse_set_t* s, int k) {
+    if (!sparse_set_has(s, k)) return;
+    int last = s->dense[--s->n];  // Move the last member into the hole
+    s->dense[s->sparse[k]] = last;
+    s->sparse[last] = s->sparse[k];
+}
+
+
+void sparse_set_clear(sparse_set_t* s) {
+    s->n = 0;
+}
+
+
+void sparse_set_from_bits(sparse_set_t* s, const word_t* bits) {
+    s->n = 0;
+    int nwords = bitset_words(s->universe);
+    for (int w = 0; w < nwords; w++) {
+        for (word_t b = bits[w]; b; b &= b - 1) {
+            int k = w * WORD_BITS + __builtin_ctzll(b);
+            s->sparse[k] = s->n;
+            s->dense[s->n++] = k;
+        }
+    }
+}
+
+
+dataflow_t* dataflow_new(cfg_t* cfg, int nbits) {
+    dataflow_t* df = malloc(sizeof(dataflow_t));
+    df->nbits = nbits;
+    df->nwords = bitset_words(nbits);
+    df->nblocks = cfg->nblocks;
+    size_t per_kind = (size_t)df->nblocks * df->nwords;
+    df->storage = calloc(4 * per_kind + 1, sizeof(word_t));
+    word_t*** kinds[4] = { &df->in, &df->out, &df->gen, &df->kill };
+    for (int k = 0; k < 4; k++) {
+        *kinds[k] = malloc((df->nblocks ? df->nblocks : 1) * sizeof(word_t*));
+        for (int b = 0; b < df->nblocks; b++) (*kinds[k])[b] = df->storage + k * per_kind + (size_t)b * df->nwords;
+    }
+    return df;
+}
+
+
+void dataflow_free(dataflow_t* df) {
+    free(df->in);
+    free(df->out);
+    free(df->gen);
+    free(df->kill);
+    free(df->storage);
+    free(df);
+}
+
+
+void dataflow_solve(dataflow_t* df, cfg_t* cfg, df_direction_t dir, df_meet_t meet) {
+    int n = df->nblocks;
+    int nw = df->nwords;
+    word_t last_mask = df->nbits % WORD_BITS ? ((word_t)1 << (df->nbits % WORD_BITS)) - 1 : ~(word_t)0;
+    word_t** met = dir == DF_FORWARD ? df->in : df->out;  // Side computed by the meet
+    word_t** result = dir == DF_FORWARD ? df->out : df->in;  // Side computed by the transfer
+    if (meet == DF_INTERSECTION) {  // Start from the top of the lattice so intersections can only shrink
+        for (int b = 0; b < n; b++) {
+            if (nw == 0) break;
+            memset(result[b], 0xff, nw * sizeof(word_t));
+            result[b][nw - 1] &= last_mask;
+        }
+    }
+
+    // Circular worklist: each block at most once at a time. Reachable blocks in (reverse) postorder
+    // first so most edges are seen in their final state, then the unreachable rest
+    int* queue = malloc((n + 1) * sizeof(int));
+    char* queued = calloc(n ? n : 1, 1);
+    int head = 0;
+    int count = 0;
+    for (int r = 0; r < cfg->nrpo; r++) {
+        bb_t* b = cfg->rpo[dir == DF_FORWARD ? r : cfg->nrpo - 1 - r];
+        queue[count++] = b->id;
+        queued[b->id] = 1;
+    }
+    for (int b = 0; b < n; b++) {
+        if (!queued[b]) {
+            queue[count++] = b;
+            queued[b] = 1;
+        }
+    }
+
+    word_t* fresh = malloc((nw ? nw : 1) * sizeof(word_t));
+    while (count) {
+        int id = queue[head];
+        head = (head + 1) % (n + 1);
+        count--;
+        queued[id] = 0;
+        bb_t* b = cfg->blocks[id];
+        bb_t** edges = dir == DF_FORWARD ? b->preds : b->succs;
+        int nedges = dir == DF_FORWARD ? b->npreds : b->nsuccs;
+
+        word_t* m = met[id];
+        if (nedges == 0) {
+            memset(m, 0, nw * sizeof(word_t));
+        } else {
+            memcpy(m, result[edges[0]->id], nw * sizeof(word_t));
+            for (int e = 1; e < nedges; e++) {
+                word_t* other = result[edges[e]->id];
+                if (meet == DF_UNION) for (int w = 0; w < nw; w++) m[w] |= other[w];
+                else for (int w = 0; w < nw; w++) m[w] &= other[w];
+            }
+        }
+
+        word_t* gen = df->gen[id];
+        word_t* kill = df->kill[id];
+        int changed = 0;
+        for (int w = 0; w < nw; w++) {
+            fresh[w] = gen[w] | (m[w] & ~kill[w]);
+            if (fresh[w] != result[id][w]) changed = 1;
+        }
+        if (!changed) continue;
+        memcpy(result[id], fresh, nw * sizeof(word_t));
+        bb_t** deps = dir == DF_FORWARD ? b->succs : b->preds;  // Blocks whose meet reads this result
+        int ndeps = dir == DF_FORWARD ? b->nsuccs : b->npreds;
+        for (int d = 0; d < ndeps; d++) {
+            int t = deps[d]->id;
+            if (queued[t]) continue;
+            queued[t] = 1;
+            queue[(head + count) % (n + 1)] = t;
+            count++;
+        }
+    }
+    free(fresh);
+    free(queue);
+    free(queued);
+}
+
+
+dataflow_t* compute_liveness(cfg_t* cfg, int limit) {
+    dataflow_t* df = dataflow_new(cfg, limit);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        word_t* gen = df->gen[k];  // Used before any definition in the block
+        word_t* kill = df->kill[k];  // Defined in the block
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id >= 0 && id < limit && !bit_test(kill, id)) bit_set(gen, id);
+            }
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (id >= 0 && id < limit) bit_set(kill, id);
+        }
+    }
+    dataflow_solve(df, cfg, DF_BACKWARD, DF_UNION);
+    return df;
+}
+
+
+static void print_set(FILE* out, const char* what, const word_t* s, int nwords) {
+    fprintf(out, "    %s:", what);
+    for (int w = 0; w < nwords; w++) {
+        for (word_t b = s[w]; b; b &= b - 1) fprintf(out, " t%d", w * WORD_BITS + __builtin_ctzll(b));
+    }
+    fprintf(out, "\n");
+}
+
+
+void print_liveness(cfg_t* cfg, FILE* out) {
+    dataflow_t* lv = compute_liveness(cfg, cfg_vreg_limit(cfg));
+    fprintf(out, "%s:\n", cfg->func->name);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        fprintf(out, "  B%d", b->id);
+        if (b->label) fprintf(out, " (%s)", b->label);
+        fprintf(out, "\n");
+        print_set(out, "live-in", lv->in[k], lv->nwords);
+        print_set(out, "live-out", lv->out[k], lv->nwords);
+    }
+    dataflow_free(lv);
+}
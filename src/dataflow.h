@@ -0,0 +1,72 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdio.h>
+#include "cfg.h"
+
+
+// Dense bitset: one bit per element, WORD_BITS to a word
+typedef unsigned long long word_t;
+#define WORD_BITS 64
+
+int bitset_words(int nbits);
+int bit_test(const word_t* s, int k);
+void bit_set(word_t* s, int k);
+void bit_clear(word_t* s, int k);
+
+
+// Sparse set (Briggs and Torczon) over 0 .. universe-1: constant-time add, remove, membership and clear,
+// and iteration that only touches members (dense[0 .. n)). Suited to the live set of a walk through a
+// block, which stays small while the number of virtual registers is large
+typedef struct {
+    int* dense;
+    int* sparse;
+    int n;
+    int universe;
+} sparse_set_t;
+
+sparse_set_t* sparse_set_new(int universe);
+void sparse_set_free(sparse_set_t* s);
+int sparse_set_has(const sparse_set_t* s, int k);
+void sparse_set_add(sparse_set_t* s, int k);
+void sparse_set_remove(sparse_set_t* s, int k);
+void sparse_set_clear(sparse_set_t* s);
+void sparse_set_from_bits(sparse_set_t* s, const word_t* bits);  // Replace the contents by a bitset's
+
+
+// Bitvector dataflow problem over a CFG: per block in/out sets and the gen/kill sets of its transfer
+// function, out = gen | (in & ~kill) going forward and in = gen | (out & ~kill) going backward. Each
+// kind of set is one contiguous array (nblocks * nwords words)
+typedef enum { DF_FORWARD, DF_BACKWARD } df_direction_t;
+typedef enum { DF_UNION, DF_INTERSECTION } df_meet_t;
+
+typedef struct {
+    int nbits;
+    int nwords;
+    int nblocks;
+    word_t** in;  // Indexed by block id
+    word_t** out;
+    word_t** gen;
+    word_t** kill;
+    word_t* storage;
+} dataflow_t;
+
+dataflow_t* dataflow_new(cfg_t* cfg, int nbits);  // All sets empty; the caller fills gen and kill
+
+
+// Iterate to the fixpoint with a worklist seeded in reverse postorder (forward) or postorder (backward).
+// Blocks without predecessors (forward) or successors (backward) meet over nothing: the empty set
+void dataflow_solve(dataflow_t* df, cfg_t* cfg, df_direction_t dir, df_meet_t meet);
+
+void dataflow_free(dataflow_t* df);
+
+
+// Live virtual registers: bit v of in[b] / out[b] is set when tv is live on entry to / exit from b.
+// limit is cfg_vreg_limit(cfg)
+dataflow_t* compute_liveness(cfg_t* cfg, int limit);
+
+
+// Debug view (--dump-liveness): each block's live-in and live-out registers
+void print_liveness(cfg_t* cfg, FILE* out);
+
+#endif
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dce.h"
+#include "ssa.h"
+
+
+typedef struct {
+    int* items;
+    int n;
+    int cap;
+} int_list_t;
+
+
+static void int_list_push(int_list_t* l, int v) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 4;
+        l->items = realloc(l->items, l->cap * sizeof(int));
+    }
+    l->items[l->n++] = v;
+}
+
+
+typedef struct {
+    cfg_t* cfg;
+    ssa_info_t* info;
+    int_list_t* cd;  // cd[b]: blocks whose branch decides whether b executes
+    char* live_vreg;
+    char* live_block;
+    char* live_branch;
+    ssa_site_t* work;
+    int nwork;
+    int work_cap;
+} dce_state_t;
+
+
+static void push_site(dce_state_t* st, ir_instr_t* i, bb_t* b) {
+    if (st->nwork == st->work_cap) {
+        st->work_cap = st->work_cap ? st->work_cap * 2 : 64;
+        st->work = realloc(st->work, st->work_cap * sizeof(ssa_site_t));
+    }
+    st->work[st->nwork].instr = i;
+    st->work[st->nwork].block = b;
+    st->nwork++;
+}
+
+
+static void mark_vreg(dce_state_t* st, const char* name) {
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= st->info->limit || st->live_vreg[id]) return;
+    st->live_vreg[id] = 1;
+    if (st->info->defs[id].instr) push_site(st, st->info->defs[id].instr, st->info->defs[id].block);
+}
+
+
+static void mark_block(dce_state_t* st, bb_t* b) {
+    if (st->live_block[b->id]) return;
+    st->live_block[b->id] = 1;
+    for (int k = 0; k < st->cd[b->id].n; k++) {
+        bb_t* y = st->cfg->blocks[st->cd[b->id].items[k]];
+        if (st->live_branch[y->id]) continue;
+        st->live_branch[y->id] = 1;
+        push_site(st, y->last, y);
+    }
+}
+
+
+static ir_instr_t* def_of(ssa_info_t* info, const char* name) {
+    int id = ir_vreg_id(name);
+    return id >= 0 && id < info->limit ? info->defs[id].instr : NULL;
+}
+
+
+// Instructions kept no matter what: memory writes, calls, returns, writes to physical registers, and
+// what could fault as at -O0 (like LICM, which will not hoist them): divisions unless by a nonzero
+// constant, and loads unless from a variable's address
+static int is_critical(ssa_info_t* info, ir_instr_t* i) {
+    switch (i->op) {
+        case IR_SW: case IR_JAL: case IR_JALR: case IR_JR:
+        case IR_SYSC: case IR_ERET: case IR_MOVG2S: case IR_MOVS2G:
+            return 1;
+        case IR_DIV: case IR_DIVU: {
+            ir_instr_t* divisor = def_of(info, i->src2);
+            if (!divisor || divisor->op != IR_LI || !divisor->imm) return 1;
+            break;
+        }
+        case IR_LW: {
+            ir_instr_t* base = def_of(info, i->src1);
+            if (!base || base->op != IR_LA) return 1;
+            break;
+        }
+        default: break;
+    }
+    char** d = ir_def(i);
+    return d && ir_vreg_id(*d) < 0;
+}
+
+
+static int is_branch_block(bb_t* b) {
+    return b->last && ir_is_cond_branch(b->last->op);
+}
+
+
+// Turn the dead branch ending y into `j target`, where target = ipdom(y). Phis in target get the
+// operand that flowed in from y's side; every path from y carries the same one, or y would be live
+static void redirect_branch(cfg_t* cfg, bb_t* y, bb_t* target) {
+    ir_func_t* f = cfg->func;
+    bb_t* src = NULL;
+    if (cfg_pred_index(target, y) >= 0) {
+        src = y;
+    } else {  // First predecessor of target reachable from y without passing target
+        char* seen = calloc(cfg->nblocks, 1);
+        bb_t** stack = malloc(cfg->nblocks * sizeof(bb_t*));
+        int sp = 0;
+        stack[sp++] = y;
+        seen[y->id] = 1;
+        while (sp && !src) {
+            bb_t* b = stack[--sp];
+            for (int s = 0; s < b->nsuccs; s++) {
+                bb_t* w = b->succs[s];
+                if (w == target) {
+                    src = b;
+                    break;
+                }
+                if (!seen[w->id]) {
+                    seen[w->id] = 1;
+                    stack[sp++] = w;
+                }
+            }
+        }
+        free(seen);
+        free(stack);
+    }
+
+    int j = src ? cfg_pred_index(target, src) : -1;
+    int nphis = 0;
+    for (ir_instr_t* i = target->first; i; i = i->next) {
+        if (i->op == IR_PHI) nphis++;
+        else if (i->op != IR_LABEL) break;
+    }
+    char** vals = malloc((nphis ? nphis : 1) * sizeof(char*));
+    nphis = 0;
+    for (ir_instr_t* i = target->first; i; i = i->next) {
+        if (i->op == IR_PHI) vals[nphis++] = j >= 0 ? i->args[j] : ir_intern(f, "$zero");
+        else if (i->op != IR_LABEL) break;
+    }
+
+    while (y->nsuccs) ssa_remove_edge(y, y->succs[0]);
+    y->last->op = IR_J;
+    y->last->dest = target->label;
+    y->last->src1 = NULL;
+    y->last->src2 = NULL;
+    cfg_add_edge(cfg, y, target);
+
+    nphis = 0;
+    for (ir_instr_t* i = target->first; i; i = i->next) {
+        if (i->op == IR_LABEL) continue;
+        if (i->op != IR_PHI) break;
+        char** args = arena_alloc(f->arena, (i->nargs + 1) * sizeof(char*));
+        memcpy(args, i->args, i->nargs * sizeof(char*));
+        args[i->nargs++] = vals[nphis++];
+        i->args = args;
+    }
+    free(vals);
+}
+
+
+int dce(cfg_t* cfg) {
+    pdom_t pd;
+    pd.cfg = cfg;
+    compute_postdominators(&pd);
+
+    dce_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    st.info = ssa_build_info(cfg);
+    st.cd = calloc(cfg->nblocks, sizeof(int_list_t));
+    st.live_vreg = calloc(st.info->limit ? st.info->limit : 1, 1);
+    st.live_block = calloc(cfg->nblocks, 1);
+    st.live_branch = calloc(cfg->nblocks, 1);
+
+    // Control dependence = postdominance frontier: walk up from each successor of a branch to its ipdom
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* y = cfg->blocks[k];
+        if (y->nsuccs < 2 && !(pd.exit_pred[k] && y->nsuccs)) continue;
+        for (int s = 0; s < y->nsuccs; s++) {
+            int runner = y->succs[s]->id;
+            while (runner != pd.ipdom[k] && runner != pd.exit && runner >= 0) {
+                int_list_push(&st.cd[runner], k);
+                runner = pd.ipdom[runner];
+            }
+        }
+    }
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (is_critical(st.info, i)) push_site(&st, i, b);
+        }
+        if (pd.exit_pred[k] && b->nsuccs && is_branch_block(b)) {  // Never-ending loops stay
+            st.live_branch[k] = 1;
+            push_site(&st, b->last, b);
+        }
+        if (pd.exit_pred[k] && b->nsuccs) mark_block(&st, b);
+    }
+
+    while (st.nwork) {
+        while (st.nwork) {
+            ssa_site_t site = st.work[--st.nwork];
+            ir_instr_t* i = site.instr;
+            mark_block(&st, site.block);
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) mark_vreg(&st, *slots[s]);
+            for (int a = 0; a < i->nargs; a++) {
+                mark_vreg(&st, i->args[a]);
+                mark_block(&st, site.block->preds[a]);  // Which edge was taken picks the operand
+            }
+        }
+        // A dead branch needs a real block to jump to instead; keep the rare one without
+        for (int k = 0; k < cfg->nblocks; k++) {
+            bb_t* y = cfg->blocks[k];
+            if (!is_branch_block(y) || st.live_branch[k] || (pd.ipdom[k] >= 0 && pd.ipdom[k] != pd.exit)) continue;
+            st.live_branch[k] = 1;
+            push_site(&st, y->last, y);
+        }
+    }
+
+    int removed = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            int dead = i->op == IR_NOP || (id >= 0 && !st.live_vreg[id] && !is_critical(st.info, i));
+            if (dead) {
+                if (prev) prev->next = next;
+                else b->first = next;
+                if (b->last == i) b->last = prev;
+                removed++;
+            } else {
+                prev = i;
+            }
+            i = next;
+        }
+    }
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* y = cfg->blocks[k];
+        if (!is_branch_block(y) || st.live_branch[k]) continue;
+        redirect_branch(cfg, y, cfg->blocks[pd.ipdom[k]]);
+        removed++;
+    }
+    ssa_remove_unreachable(cfg);
+
+    for (int k = 0; k < pd.exit; k++) free(st.cd[k].items);
+    free(st.cd);
+    free(st.live_vreg);
+    free(st.live_block);
+    free(st.live_branch);
+    free(st.work);
+    ssa_free_info(st.info);
+    free_postdominators(&pd);
+    return removed;
+}
+
+
+// Later stores of a block remembered at once while looking for the ones they overwrite
+#define MAX_PENDING_STORES 32
+
+
+int dse(cfg_t* cfg) {
+    int removed = 0;
+    ir_instr_t* pending[MAX_PENDING_STORES];  // Later stores in the block no instruction since may read
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        int n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) n++;
+        ir_instr_t** instrs = malloc((n ? n : 1) * sizeof(ir_instr_t*));
+        char* dead = calloc(n ? n : 1, 1);
+        n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) instrs[n++] = i;
+
+        int npending = 0;
+        for (int j = n - 1; j >= 0; j--) {
+            ir_instr_t* i = instrs[j];
+            if (i->op == IR_SW) {
+                for (int p = 0; p < npending && !dead[j]; p++) {
+                    dead[j] = pending[p]->src1 == i->src1 && pending[p]->imm == i->imm;
+                }
+                if (!dead[j] && npending < MAX_PENDING_STORES) pending[npending++] = i;
+                continue;
+            }
+            if (i->op == IR_JAL || i->op == IR_JALR || i->op == IR_JR || i->op == IR_SYSC || i->op == IR_ERET) {
+                npending = 0;  // The callee, caller or system may read anything
+                continue;
+            }
+            char** d = ir_def(i);
+            int kept = 0;
+            for (int p = 0; p < npending; p++) {
+                ir_instr_t* s = pending[p];
+                int read = i->op == IR_LW && (s->src1 == i->src1 ? s->imm == i->imm : ir_may_alias(s->mem, i->mem));
+                if (!read && !(d && *d == s->src1)) pending[kept++] = s;  // A new base value is another address
+            }
+            npending = kept;
+        }
+
+        ir_instr_t* prev = NULL;
+        for (int j = 0; j < n; j++) {
+            if (!dead[j]) {
+                if (prev) prev->next = instrs[j];
+                else b->first = instrs[j];
+                prev = instrs[j];
+                continue;
+            }
+            removed++;
+        }
+        if (prev) prev->next = NULL;
+        else b->first = NULL;
+        b->last = prev;
+        free(instrs);
+        free(dead);
+    }
+    return removed;
+}
+
+
+static ir_func_t* find_func(ir_program_t* ir, const char* name) {
+    for (ir_func_t* f = ir->functions; f; f = f->next) {
+        if (strcmp(f->name, name) == 0) return f;
+    }
+    return NULL;
+}
+
+
+void dce_program(ir_program_t* ir, int* removed_funcs, int* removed_globals) {
+    *removed_funcs = 0;
+    *removed_globals = 0;
+    ir_func_t* main_f = find_func(ir, "main");
+    if (!main_f) return;
+
+    int nfuncs = 0;
+    for (ir_func_t* f = ir->functions; f; f = f->next) nfuncs++;
+    ir_func_t** work = malloc(nfuncs * sizeof(ir_func_t*));
+    char** reached = malloc(nfuncs * sizeof(char*));  // Names of reached functions (the worklist's prefix)
+    int nreached = 0;
+    int head = 0;
+    work[nreached] = main_f;
+    reached[nreached++] = main_f->name;
+    while (head < nreached) {
+        ir_func_t* f = work[head++];
+        for (ir_instr_t* i = f->body; i; i = i->next) {
+            if (i->op != IR_JAL) continue;
+            ir_func_t* callee = find_func(ir, i->dest);  // Runtime helpers (mult, div) have no IR
+            if (!callee) continue;
+            int seen = 0;
+            for (int k = 0; k < nreached && !seen; k++) seen = reached[k] == callee->name;
+            if (seen) continue;
+            work[nreached] = callee;
+            reached[nreached++] = callee->name;
+        }
+    }
+
+    ir_func_t** link = &ir->functions;
+    while (*link) {
+        ir_func_t* f = *link;
+        int live = 0;
+        for (int k = 0; k < nreached && !live; k++) live = reached[k] == f->name;
+        if (live) {
+            link = &f->next;
+            continue;
+        }
+        *link = f->next;
+        free_ir_func(f);
+        free(f);
+        (*removed_funcs)++;
+    }
+    free(work);
+    free(reached);
+
+    for (decl_t* g = ir->globals; g; g = g->next) {
+        if (g->kind != DECL_VAR) continue;
+        int used = 0;
+        for (ir_func_t* f = ir->functions; f && !used; f = f->next) {
+            if (ir_find_var(f, g->name)) continue;  // Shadowed by a local or parameter
+            for (ir_instr_t* i = f->body; i && !used; i = i->next) {
+                used = i->op == IR_LA && strcmp(i->src1, g->name) == 0;
+            }
+        }
+        if (used) continue;
+        ir->dead_globals = realloc(ir->dead_globals, (ir->ndead_globals + 1) * sizeof(char*));
+        ir->dead_globals[ir->ndead_globals++] = g->name;
+        (*removed_globals)++;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include "cfg.h"
+
+
+// Aggressive dead code elimination over SSA (mark and sweep, Cytron et al.): only instructions with a
+// side effect and whatever they depend on, through data or control, are kept. Divisions and loads that
+// could fault count as side effects, as they do for LICM. Branches nothing live depends on become jumps
+// to their immediate postdominator. Returns the number of instructions removed
+int dce(cfg_t* cfg);
+
+
+// Dead store elimination within blocks: a store is dropped when a later store in its block writes the
+// same word (same base register and offset) and nothing in between may read it. Calls, returns and
+// system instructions read everything; loads read what their type-based alias class may overlap.
+// Returns the number of stores removed
+int dse(cfg_t* cfg);
+
+
+// Whole-program sweep: drop functions not reachable from main through calls and globals that no
+// remaining function references. Does nothing for programs without a main
+void dce_program(ir_program_t* ir, int* removed_funcs, int* removed_globals);
+
+#endif
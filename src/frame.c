@@ -0,0 +1,501 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame.h"
+#include "cfg.h"
+#include "dataflow.h"
+
+
+// Counters for --stats
+static int frame_funcs = 0;
+static int frameless_leaves = 0;
+static int shrink_wrapped = 0;
+static int frame_bytes = 0;
+static int frame_bytes_unshared = 0;
+
+
+// Functions with more memory objects than this keep one slot each (the conflict matrix is quadratic)
+#define MAX_SHARED_OBJECTS 1024
+
+
+// A local (or register parameter) the code still addresses. Declarations of one name in several
+// blocks are one object
+typedef struct {
+    char* name;  // Interned
+    int size;  // Largest declaration, rounded to words
+    int offset;  // From $sp, or from $fp for stack parameters
+    int in_caller;  // Stack parameter: lives in the caller's outgoing-argument area
+    int addressed;  // Some la still names it
+    int pinned;  // Address copied somewhere we do not follow: conflicts with everything
+} frame_obj_t;
+
+
+typedef struct {
+    ir_func_t* f;
+    frame_obj_t* objs;
+    int nobjs;
+    char** keys;  // Name -> object (open addressing on the interned pointer)
+    int* vals;
+    int cap;
+} frame_objs_t;
+
+
+// How a virtual register holding a local's address is used
+typedef struct {
+    int defs;
+    int escapes;  // Read other than as the base of a load or store
+    int min_imm;  // Range of the offsets it is a base for
+    int max_imm;
+} addr_use_t;
+
+
+static int fits_simm16(int v) {
+    return v >= -32768 && v <= 32767;
+}
+
+
+static int vreg_limit(ir_func_t* f) {
+    int limit = 0;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        char* names[3] = {i->dest, i->src1, i->src2};
+        for (int k = 0; k < 3; k++) {
+            int id = names[k] ? ir_vreg_id(names[k]) : -1;
+            if (id >= limit) limit = id + 1;
+        }
+    }
+    return limit;
+}
+
+
+static unsigned hash_name(const char* p) {
+    unsigned long long v = (unsigned long long)(size_t)p;
+    v ^= v >> 17;
+    v *= 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(v >> 32);
+}
+
+
+// Object for a local or parameter name, -1 for globals
+static int find_obj(frame_objs_t* fo, char* name) {
+    for (unsigned h = hash_name(name) & (fo->cap - 1); fo->keys[h]; h = (h + 1) & (fo->cap - 1)) {
+        if (fo->keys[h] == name) return fo->vals[h];
+    }
+    return -1;
+}
+
+
+// One object per local or parameter name, numbered in declaration order
+static void collect_objs(frame_objs_t* fo, ir_func_t* f) {
+    int nvars = 0;
+    for (ir_var_t* v = f->vars; v; v = v->next) nvars++;
+    fo->f = f;
+    fo->cap = 16;
+    while (fo->cap < nvars * 2) fo->cap *= 2;
+    fo->keys = calloc(fo->cap, sizeof(char*));
+    fo->vals = malloc(fo->cap * sizeof(int));
+    fo->objs = malloc((nvars ? nvars : 1) * sizeof(frame_obj_t));
+    fo->nobjs = 0;
+    for (ir_var_t* v = f->vars; v; v = v->next) {
+        int size = (v->size + 3) & ~3;
+        int k = find_obj(fo, v->name);
+        if (k >= 0) {
+            if (size > fo->objs[k].size) fo->objs[k].size = size;
+            continue;
+        }
+        unsigned h = hash_name(v->name) & (fo->cap - 1);
+        while (fo->keys[h]) h = (h + 1) & (fo->cap - 1);
+        fo->keys[h] = v->name;
+        fo->vals[h] = fo->nobjs;
+        frame_obj_t* o = &fo->objs[fo->nobjs++];
+        o->name = v->name;
+        o->size = size;
+        o->in_caller = v->param_index >= NUM_ARG_REGS;
+        o->offset = o->in_caller ? 4 * (v->param_index - NUM_ARG_REGS) : -1;
+        o->addressed = 0;
+        o->pinned = 0;
+    }
+}
+
+
+static void free_objs(frame_objs_t* fo) {
+    free(fo->objs);
+    free(fo->keys);
+    free(fo->vals);
+}
+
+
+// A virtual register holding an address derived from a second object pins both
+static void set_addr(frame_objs_t* fo, int* addr_of, int v, int obj, int* changed) {
+    if (addr_of[v] == obj) return;
+    if (addr_of[v] >= 0) {
+        fo->objs[addr_of[v]].pinned = 1;
+        fo->objs[obj].pinned = 1;
+        return;
+    }
+    addr_of[v] = obj;
+    *changed = 1;
+}
+
+
+// addr_of[v]: the object whose address (plus some offset) tv may hold, -1 if none. Addresses flow through
+// arithmetic; one stored to memory or handed to a physical register is no longer tracked
+static void track_addresses(frame_objs_t* fo, int* addr_of, int limit) {
+    for (int v = 0; v < limit; v++) addr_of[v] = -1;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (ir_instr_t* i = fo->f->body; i; i = i->next) {
+            char** d = ir_def(i);
+            int dv = d ? ir_vreg_id(*d) : -1;
+            if (i->op == IR_LA) {
+                int obj = find_obj(fo, i->src1);
+                if (obj >= 0 && dv >= 0) set_addr(fo, addr_of, dv, obj, &changed);
+                continue;
+            }
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int u = ir_vreg_id(*slots[s]);
+                if (u < 0 || addr_of[u] < 0) continue;
+                if ((i->op == IR_LW || i->op == IR_SW) && slots[s] == &i->src1) continue;  // Plain access
+                if (i->op == IR_SW || dv < 0) fo->objs[addr_of[u]].pinned = 1;
+                else set_addr(fo, addr_of, dv, addr_of[u], &changed);
+            }
+        }
+    }
+}
+
+
+// Object an instruction touches: an la of it, or any use of an address derived from it
+static int accessed_obj(frame_objs_t* fo, int* addr_of, ir_instr_t* i, int* second) {
+    *second = -1;
+    if (i->op == IR_LA) return find_obj(fo, i->src1);
+    int found = -1;
+    char** slots[2];
+    int n = ir_uses(i, slots);
+    for (int s = 0; s < n; s++) {
+        int u = ir_vreg_id(*slots[s]);
+        if (u < 0 || addr_of[u] < 0) continue;
+        if (found < 0) found = addr_of[u];
+        else if (addr_of[u] != found) *second = addr_of[u];
+    }
+    return found;
+}
+
+
+// Two objects conflict when one is touched in a block where the other is live, that is, between two of
+// its accesses on some path: reached forward from one and backward from another (or accessed there)
+static word_t* build_conflicts(frame_objs_t* fo, int* addr_of) {
+    int n = fo->nobjs;
+    int nwords = bitset_words(n);
+    word_t* conflict = calloc((size_t)n * nwords, sizeof(word_t));
+    cfg_t* cfg = build_cfg(fo->f);
+    dataflow_t* fwd = dataflow_new(cfg, n);
+    dataflow_t* bwd = dataflow_new(cfg, n);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            int second;
+            int obj = accessed_obj(fo, addr_of, i, &second);
+            if (obj >= 0) bit_set(fwd->gen[k], obj);
+            if (second >= 0) bit_set(fwd->gen[k], second);
+        }
+    }
+    for (ir_var_t* v = fo->f->vars; v; v = v->next) {  // The prologue stores register parameters on entry
+        if (v->is_param && v->param_index < NUM_ARG_REGS) bit_set(fwd->gen[0], find_obj(fo, v->name));
+    }
+    for (int k = 0; k < cfg->nblocks; k++) memcpy(bwd->gen[k], fwd->gen[k], nwords * sizeof(word_t));
+    dataflow_solve(fwd, cfg, DF_FORWARD, DF_UNION);
+    dataflow_solve(bwd, cfg, DF_BACKWARD, DF_UNION);
+
+    word_t* live = malloc(nwords * sizeof(word_t));
+    for (int k = 0; k < cfg->nblocks; k++) {
+        word_t* gen = fwd->gen[k];
+        for (int w = 0; w < nwords; w++) live[w] = (fwd->in[k][w] | gen[w]) & (bwd->out[k][w] | gen[w]);
+        for (int obj = 0; obj < n; obj++) {
+            if (!bit_test(gen, obj)) continue;
+            word_t* row = conflict + (size_t)obj * nwords;
+            for (int w = 0; w < nwords; w++) row[w] |= live[w];
+        }
+    }
+    for (int a = 0; a < n; a++) {  // Symmetric; pinned objects conflict with everything
+        for (int b = 0; b < n; b++) {
+            int c = bit_test(conflict + (size_t)a * nwords, b) || fo->objs[a].pinned || fo->objs[b].pinned;
+            if (c) {
+                bit_set(conflict + (size_t)a * nwords, b);
+                bit_set(conflict + (size_t)b * nwords, a);
+            }
+        }
+    }
+    free(live);
+    dataflow_free(fwd);
+    dataflow_free(bwd);
+    linearize_cfg(cfg);
+    free_cfg(cfg);
+    return conflict;
+}
+
+
+// Stack slot coloring: each object in turn takes the lowest offset where it overlaps no conflicting
+// object placed before it (every placed object when conflict is NULL). Returns the end of the area
+static int place_objs(frame_objs_t* fo, word_t* conflict, int base) {
+    int nwords = bitset_words(fo->nobjs);
+    int end = base;
+    for (int k = 0; k < fo->nobjs; k++) {
+        frame_obj_t* o = &fo->objs[k];
+        if (!o->addressed || o->in_caller) continue;
+        int offset = base;
+        int moved = 1;
+        while (moved) {  // Slide past every conflicting object in the way
+            moved = 0;
+            for (int p = 0; p < k; p++) {
+                frame_obj_t* q = &fo->objs[p];
+                if (!q->addressed || q->in_caller || (conflict && !bit_test(conflict + (size_t)k * nwords, p))) continue;
+                if (offset < q->offset + q->size && q->offset < offset + o->size) {
+                    offset = q->offset + q->size;
+                    moved = 1;
+                }
+            }
+        }
+        o->offset = offset;
+        if (offset + o->size > end) end = offset + o->size;
+    }
+    return end;
+}
+
+
+void layout_frame(ir_func_t* f) {
+    int max_args = 0;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op == IR_JAL && i->imm > max_args) max_args = i->imm;
+    }
+    frame_objs_t fo;
+    collect_objs(&fo, f);
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        int obj = i->op == IR_LA ? find_obj(&fo, i->src1) : -1;
+        if (obj >= 0) fo.objs[obj].addressed = 1;
+    }
+
+    int limit = vreg_limit(f);
+    int* addr_of = malloc((limit ? limit : 1) * sizeof(int));
+    track_addresses(&fo, addr_of, limit);
+    word_t* conflict = fo.nobjs <= MAX_SHARED_OBJECTS ? build_conflicts(&fo, addr_of) : NULL;
+    free(addr_of);
+    int unshared = 0;
+    for (int k = 0; k < fo.nobjs; k++) {
+        if (fo.objs[k].addressed && !fo.objs[k].in_caller) unshared += fo.objs[k].size;
+    }
+    f->spill_base = place_objs(&fo, conflict, 4 * max_args);
+    f->slot_savings = unshared - (f->spill_base - 4 * max_args);
+    free(conflict);
+    for (ir_var_t* v = f->vars; v; v = v->next) {
+        frame_obj_t* o = &fo.objs[find_obj(&fo, v->name)];
+        v->offset = o->addressed || o->in_caller ? o->offset : -1;
+    }
+
+    addr_use_t* uses = calloc(limit ? limit : 1, sizeof(addr_use_t));
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        char** d = ir_def(i);
+        int id = d ? ir_vreg_id(*d) : -1;
+        if (id >= 0) uses[id].defs++;
+        char** slots[2];
+        int n = ir_uses(i, slots);
+        for (int s = 0; s < n; s++) {
+            int u = ir_vreg_id(*slots[s]);
+            if (u < 0) continue;
+            if ((i->op == IR_LW || i->op == IR_SW) && slots[s] == &i->src1) {
+                if (i->imm < uses[u].min_imm) uses[u].min_imm = i->imm;
+                if (i->imm > uses[u].max_imm) uses[u].max_imm = i->imm;
+            } else {
+                uses[u].escapes = 1;
+            }
+        }
+        for (int a = 0; a < i->nargs; a++) {
+            int u = ir_vreg_id(i->args[a]);
+            if (u >= 0) uses[u].escapes = 1;
+        }
+    }
+
+    // Addresses used only as bases vanish into the loads and stores; `base` replaces them there
+    char** base = calloc(limit ? limit : 1, sizeof(char*));
+    int* offset = calloc(limit ? limit : 1, sizeof(int));
+    char* sp = ir_intern(f, "$sp");
+    char* fp = ir_intern(f, "$fp");
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op != IR_LA) continue;
+        int obj = find_obj(&fo, i->src1);
+        if (obj < 0) continue;  // Globals keep their absolute address
+        frame_obj_t* v = &fo.objs[obj];
+        char* reg = v->in_caller ? fp : sp;
+        int id = ir_vreg_id(i->dest);
+        addr_use_t* u = id >= 0 ? &uses[id] : NULL;
+        if (u && u->defs == 1 && !u->escapes && fits_simm16(v->offset + u->min_imm) && fits_simm16(v->offset + u->max_imm)) {
+            base[id] = reg;
+            offset[id] = v->offset;
+            i->op = IR_NOP;
+            i->src1 = NULL;
+            i->dest = NULL;
+        } else if (fits_simm16(v->offset)) {
+            i->op = IR_ADDI;
+            i->src1 = reg;
+            i->imm = v->offset;
+        } else {  // Frames past 32KB: li then add
+            i->op = IR_LI;
+            i->src1 = NULL;
+            i->imm = v->offset;
+            ir_instr_t* add = new_ir(f, IR_ADD, i->dest, i->dest, reg, 0);
+            add->next = i->next;
+            i->next = add;
+        }
+    }
+
+    // Fold and drop the nops left behind
+    ir_instr_t** link = &f->body;
+    while (*link) {
+        ir_instr_t* i = *link;
+        if (i->op == IR_NOP && !i->dest) {
+            *link = i->next;
+            continue;
+        }
+        if (i->op == IR_LW || i->op == IR_SW) {
+            int id = ir_vreg_id(i->src1);
+            if (id >= 0 && base[id]) {
+                i->src1 = base[id];
+                i->imm += offset[id];
+            }
+        }
+        link = &i->next;
+    }
+
+    free(uses);
+    free(base);
+    free(offset);
+    free_objs(&fo);
+}
+
+
+static int is_call(ir_op_t op) {
+    return op == IR_JAL || op == IR_JALR || op == IR_SYSC;
+}
+
+
+static int is_return(ir_instr_t* i) {
+    return i->op == IR_JR && strcmp(i->src1, "$ra") == 0;
+}
+
+
+// Does i touch anything the prologue sets up: the stack, $fp, a callee-saved register or $ra?
+static int needs_frame(ir_instr_t* i) {
+    if (is_call(i->op)) return 1;
+    if (i->op == IR_LABEL || is_return(i)) return 0;
+    char* names[3] = {i->dest, i->src1, i->src2};
+    for (int k = 0; k < 3; k++) {
+        char* r = names[k];
+        if (r && (strcmp(r, "$sp") == 0 || strcmp(r, "$fp") == 0 || (r[0] == '$' && r[1] == 's' && r[2] >= '0' && r[2] <= '7'))) return 1;
+    }
+    return 0;
+}
+
+
+static bb_t* common_dominator(bb_t* a, bb_t* b) {
+    while (!cfg_dominates(a, b)) a = a->idom;
+    return a;
+}
+
+
+// Shrink-wrapping: the prologue goes to the nearest block S dominating every block that needs the frame
+// and the restore code to the end of the nearest block R postdominating them, both moved out of loops
+// so they run once per call. S must dominate R and R postdominate S, so every path either runs both
+// or neither. Returns outside that region leave without an epilogue. Falls back to entry and exit
+static void shrink_wrap(ir_func_t* f) {
+    cfg_t* cfg = build_cfg(f);
+    pdom_t pd;
+    pd.cfg = cfg;
+    compute_postdominators(&pd);
+
+    bb_t* save = NULL;
+    int restore = -1;
+    for (int k = 0; k < cfg->nrpo; k++) {
+        bb_t* b = cfg->rpo[k];
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (needs_frame(i)) {
+                save = save ? common_dominator(save, b) : b;
+                restore = restore < 0 ? b->id : pdom_intersect(&pd, restore, b->id);
+                break;
+            }
+        }
+    }
+    while (save && save->loop) save = save->loop->header->idom;
+    while (restore >= 0 && restore != pd.exit && cfg->blocks[restore]->loop) restore = pd.ipdom[restore];
+
+    int ok = save && restore >= 0 && restore != pd.exit;
+    bb_t* r = ok ? cfg->blocks[restore] : NULL;
+    if (ok) {  // R must postdominate S and be dominated by it
+        int v = save->id;
+        while (v != restore && v != pd.exit) v = pd.ipdom[v];
+        ok = v == restore && cfg_dominates(save, r);
+    }
+    int r_returns = ok && r->last && is_return(r->last);
+    if (ok && !r_returns && r->last && (ir_is_cond_branch(r->last->op) || r->last->op == IR_J) && needs_frame(r->last)) ok = 0;
+    if (ok && save == cfg->blocks[0] && r_returns) ok = 0;  // Entry to return: the usual frame
+
+    if (ok) {
+        if (save != cfg->blocks[0]) f->save_point = save->first;
+        if (!r_returns) {  // Restore before the block's branch, or at its end when it falls through
+            ir_instr_t* after = r->last;
+            if (r->last && (ir_is_cond_branch(r->last->op) || r->last->op == IR_J)) {
+                after = NULL;
+                for (ir_instr_t* i = r->first; i != r->last; i = i->next) after = i;
+            }
+            f->restore_point = after;
+        }
+        for (int k = 0; k < cfg->nblocks; k++) {
+            bb_t* b = cfg->blocks[k];
+            if (b->last && is_return(b->last) && b != r) b->last->imm = 1;
+        }
+        shrink_wrapped++;
+    }
+
+    free_postdominators(&pd);
+    linearize_cfg(cfg);
+    free_cfg(cfg);
+}
+
+
+void finish_frame(ir_func_t* f) {
+    f->is_leaf = 1;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (is_call(i->op)) f->is_leaf = 0;
+    }
+    int size = f->spill_base + 4 * f->spill_slots + 4 * __builtin_popcount(f->saved_regs);
+    if (!f->is_leaf) size += 8;  // ra + fp
+    f->frame_size = (size + 3) & ~3;  // Cool trick to align to 4 bytes
+    frame_bytes += f->frame_size;
+    frame_bytes_unshared += f->frame_size + f->slot_savings;
+    f->save_point = NULL;
+    f->restore_point = NULL;
+    frame_funcs++;
+
+    if (f->is_leaf) {  // No $fp: stack parameters are just above the frame
+        for (ir_instr_t* i = f->body; i; i = i->next) {
+            if (i->src1 && strcmp(i->src1, "$fp") == 0) {
+                i->src1 = ir_intern(f, "$sp");
+                i->imm += f->frame_size;
+            }
+        }
+    }
+    if (f->frame_size == 0) {
+        for (ir_instr_t* i = f->body; i; i = i->next) {
+            if (is_return(i)) i->imm = 1;
+        }
+        frameless_leaves++;
+        return;
+    }
+    shrink_wrap(f);
+}
+
+
+void print_frame_stats(FILE* out) {
+    if (!frame_funcs) return;
+    fprintf(out, "Frames: %d functions, %d without a frame, %d with a shrink-wrapped prologue\n", frame_funcs, frameless_leaves, shrink_wrapped);
+    fprintf(out, "Frame size: %d bytes in all, %d with one slot per local and spilled value\n", frame_bytes, frame_bytes_unshared);
+}
@@ -0,0 +1,29 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "IR.h"
+
+
+// Stack frame, from $sp up: outgoing arguments of the call passing the most on the stack, locals still
+// in memory, spill slots, saved $s registers, $fp, $ra. $fp holds the caller's $sp, so stack parameter
+// k sits at 4(k - NUM_ARG_REGS)($fp) in the caller's outgoing-argument area. Register parameters kept in
+// memory get a slot like locals, filled from $a0-$a3 by the prologue. Leaf functions drop the $fp and
+// $ra words and address stack parameters from $sp.
+
+// Give every local and parameter the function still addresses an offset and rewrite its la: folded into
+// the offset of the loads and stores that only use it as a base, an addi from $sp or $fp otherwise.
+// Locals whose lifetimes (from the first to the last access on any path) never meet share space.
+// Sets spill_base; runs before register allocation
+void layout_frame(ir_func_t* f);
+
+
+// Fix frame_size once register allocation has chosen the spill slots and callee-saved registers. Leaf
+// functions keep no $ra/$fp slots (and none at all when everything fits in registers). The prologue and
+// the frame teardown are shrink-wrapped around the blocks that use the stack, $s registers or calls
+void finish_frame(ir_func_t* f);
+
+
+// Frame counters for --stats
+void print_frame_stats(FILE* out);
+
+#endif
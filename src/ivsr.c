@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ivsr.h"
+#include "ssa.h"
+
+
+#define NOT_AFFINE -2
+#define INVARIANT -1
+#define MAX_SCALE 4096
+
+
+// scale * (basic induction variable iv) + base + offset, with base a register the loop never writes
+typedef struct {
+    int iv;  // Index of the header phi, INVARIANT for no iv part, NOT_AFFINE for anything else
+    int scale;
+    char* base;
+    long long offset;
+} affine_t;
+
+
+// A new pointer: scale * iv + base, advanced by the latch
+typedef struct {
+    int iv;
+    int scale;
+    char* base;
+    char* ptr;
+    int every_iteration;  // Dereferenced in a block that runs on every iteration
+} recurrence_t;
+
+
+typedef struct {
+    cfg_t* cfg;
+    ssa_info_t* info;
+    char* in_loop;  // By block id
+    affine_t* aff;  // By vreg id, for the nvals registers there were before rewriting
+    int nvals;
+    ir_instr_t** phis;  // Header phis, indexed by iv
+    int* steps;  // Step of each phi, 0 when it is not an induction variable
+    int nphis;
+    bb_t* header;
+    bb_t* pre;
+    bb_t* latch;
+    int ipre;
+    int ilatch;
+    char* zero;
+} iv_state_t;
+
+
+static int fits_imm(long long v) {
+    return v >= -32768 && v <= 32767;
+}
+
+
+static int in_loop_def(iv_state_t* st, const char* name) {
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= st->nvals || !st->info->defs[id].block) return -1;
+    return st->in_loop[st->info->defs[id].block->id] ? id : -1;
+}
+
+
+static affine_t value_of(iv_state_t* st, char* name) {
+    affine_t a = {NOT_AFFINE, 0, NULL, 0};
+    if (name == st->zero) {
+        a.iv = INVARIANT;
+        return a;
+    }
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= st->nvals || !st->info->defs[id].block) return a;  // Physical registers change under the loop
+    if (st->in_loop[st->info->defs[id].block->id]) return st->aff[id];
+    a.iv = INVARIANT;
+    ir_instr_t* def = st->info->defs[id].instr;
+    if (def->op == IR_LI) a.offset = def->imm;
+    else a.base = name;
+    return a;
+}
+
+
+static affine_t add_affine(affine_t x, affine_t y) {
+    affine_t a = {NOT_AFFINE, 0, NULL, 0};
+    if (x.iv == NOT_AFFINE || y.iv == NOT_AFFINE) return a;
+    if (x.iv >= 0 && y.iv >= 0 && x.iv != y.iv) return a;
+    if (x.base && y.base) return a;
+    a.iv = x.iv >= 0 ? x.iv : y.iv;
+    a.scale = x.scale + y.scale;
+    a.base = x.base ? x.base : y.base;
+    a.offset = x.offset + y.offset;
+    if (a.scale > MAX_SCALE || !fits_imm(a.offset)) a.iv = NOT_AFFINE;
+    return a;
+}
+
+
+// Affine form of every value the loop computes, in dominance order so operands come first
+static void analyze_values(iv_state_t* st) {
+    for (int id = 0; id < st->nvals; id++) st->aff[id].iv = NOT_AFFINE;
+    for (int k = 0; k < st->nphis; k++) {
+        if (!st->steps[k]) continue;
+        affine_t* a = &st->aff[ir_vreg_id(st->phis[k]->dest)];
+        a->iv = k;
+        a->scale = 1;
+        a->base = NULL;
+        a->offset = 0;
+    }
+    for (int k = 0; k < st->cfg->nrpo; k++) {
+        bb_t* b = st->cfg->rpo[k];
+        if (!st->in_loop[b->id]) continue;
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (id < 0 || id >= st->nvals || i->op == IR_PHI) continue;
+            switch (i->op) {
+                case IR_ADD: case IR_ADDU:
+                    st->aff[id] = add_affine(value_of(st, i->src1), value_of(st, i->src2));
+                    break;
+                case IR_ADDI: case IR_ADDIU: {
+                    affine_t imm = {INVARIANT, 0, NULL, i->imm};
+                    st->aff[id] = add_affine(value_of(st, i->src1), imm);
+                    break;
+                }
+                case IR_MOVE:
+                    st->aff[id] = value_of(st, i->src1);
+                    break;
+                default: break;
+            }
+            if (st->aff[id].iv == INVARIANT) st->aff[id].iv = NOT_AFFINE;  // Left to LICM
+        }
+    }
+}
+
+
+// Basic induction variables: header phis whose value from the latch is the phi plus a constant
+static void find_ivs(iv_state_t* st) {
+    for (int k = 0; k < st->nphis; k++) st->steps[k] = 1;  // Assume all, then drop the ones that are not
+    analyze_values(st);
+    for (int k = 0; k < st->nphis; k++) {
+        affine_t a = value_of(st, st->phis[k]->args[st->ilatch]);
+        int ok = a.iv == k && a.scale == 1 && !a.base && a.offset;
+        st->steps[k] = ok ? (int)a.offset : 0;
+    }
+    analyze_values(st);  // An iv's own step never depends on a phi just dropped
+}
+
+
+static char* emit(iv_state_t* st, bb_t* b, ir_op_t op, char* src1, char* src2, int imm) {
+    char* t = new_temp(st->cfg->func);
+    cfg_insert_at_end(b, new_ir(st->cfg->func, op, t, src1, src2, imm));
+    return t;
+}
+
+
+static int constant_value(iv_state_t* st, const char* name, int* val) {
+    if (name == st->zero) {
+        *val = 0;
+        return 1;
+    }
+    int id = ir_vreg_id(name);
+    ir_instr_t* def = id >= 0 && id < st->info->limit ? st->info->defs[id].instr : NULL;
+    if (!def || def->op != IR_LI) return 0;
+    *val = def->imm;
+    return 1;
+}
+
+
+// scale * x + base at the end of the preheader, by doubling
+static char* emit_start(iv_state_t* st, char* x, int scale, char* base) {
+    int v;
+    char* acc = NULL;
+    if (constant_value(st, x, &v)) {
+        int start = (int)((unsigned)v * (unsigned)scale);
+        if (base && fits_imm(start)) return start ? emit(st, st->pre, IR_ADDI, base, NULL, start) : base;
+        acc = emit(st, st->pre, IR_LI, NULL, NULL, start);
+    } else {
+        char* pow = x;
+        for (unsigned m = scale; m; m >>= 1) {
+            if (m & 1) acc = acc ? emit(st, st->pre, IR_ADDU, acc, pow, 0) : pow;
+            if (m > 1) pow = emit(st, st->pre, IR_ADDU, pow, pow, 0);
+        }
+    }
+    return base ? emit(st, st->pre, IR_ADDU, acc, base, 0) : acc;
+}
+
+
+static recurrence_t* find_recurrence(recurrence_t* recs, int n, affine_t* a) {
+    for (int k = 0; k < n; k++) {
+        if (recs[k].iv == a->iv && recs[k].scale == a->scale && recs[k].base == a->base) return &recs[k];
+    }
+    return NULL;
+}
+
+
+// Loads and stores addressed by scale * iv + base + offset use the recurrence's pointer instead
+static int reduce_addresses(iv_state_t* st, loop_t* l, recurrence_t* recs, int* nrecs) {
+    ir_func_t* f = st->cfg->func;
+    int added = 0;
+    for (int k = 0; k < l->nblocks; k++) {
+        bb_t* b = l->blocks[k];
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (i->op != IR_LW && i->op != IR_SW) continue;
+            int id = in_loop_def(st, i->src1);
+            if (id < 0) continue;
+            affine_t a = st->aff[id];
+            if (a.iv < 0 || (a.scale == 1 && !a.base) || !fits_imm(i->imm + a.offset)) continue;
+            long long step = (long long)a.scale * st->steps[a.iv];
+            if (!fits_imm(step)) continue;
+
+            recurrence_t* r = find_recurrence(recs, *nrecs, &a);
+            if (!r) {
+                r = &recs[(*nrecs)++];
+                r->iv = a.iv;
+                r->scale = a.scale;
+                r->base = a.base;
+                r->every_iteration = 0;
+                r->ptr = new_temp(f);
+                ir_instr_t* iv = st->phis[a.iv];
+                ir_instr_t* phi = new_ir(f, IR_PHI, r->ptr, NULL, NULL, 0);
+                phi->nargs = iv->nargs;
+                phi->args = arena_alloc(f->arena, phi->nargs * sizeof(char*));
+                phi->args[st->ipre] = emit_start(st, iv->args[st->ipre], a.scale, a.base);
+                phi->args[st->ilatch] = emit(st, st->latch, IR_ADDI, r->ptr, NULL, (int)step);
+                cfg_insert_at_start(st->header, phi);
+                added++;
+            }
+            i->src1 = r->ptr;
+            i->imm += (int)a.offset;
+            r->every_iteration |= cfg_dominates(b, st->latch);
+        }
+    }
+    return added;
+}
+
+
+// Is the counter k used by nothing but its own arithmetic and the exit test?
+static int only_counts(iv_state_t* st, int k, ir_instr_t* test) {
+    int phi = ir_vreg_id(st->phis[k]->dest);
+    for (int id = 0; id < st->nvals; id++) {
+        bb_t* b = st->info->defs[id].block;
+        if ((st->aff[id].iv != k && id != phi) || !b || !st->in_loop[b->id]) continue;
+        for (int u = st->info->use_start[id]; u < st->info->use_start[id + 1]; u++) {
+            ir_instr_t* user = st->info->uses[u].instr;
+            if (user == test || user == st->phis[k]) continue;
+            char** d = ir_def(user);
+            int uid = d ? in_loop_def(st, *d) : -1;
+            if (uid < 0 || st->aff[uid].iv != k) return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Exit test iv < n as pointer < scale * n + base, leaving the counter dead (see the header for when)
+static int replace_test(iv_state_t* st, recurrence_t* recs, int nrecs) {
+    ir_instr_t* br = st->header->last;
+    if (!br || (br->op != IR_BEQ && br->op != IR_BNE) || br->src2 != st->zero) return 0;
+    ir_instr_t* test = NULL;
+    for (ir_instr_t* i = st->header->first; i; i = i->next) {
+        if (i->dest == br->src1 && ir_def(i)) test = i;
+    }
+    if (!test || (test->op != IR_SLT && test->op != IR_SLTI)) return 0;
+    int k;
+    for (k = 0; k < st->nphis && st->phis[k]->dest != test->src1; k++) {}
+    if (k == st->nphis || st->steps[k] <= 0) return 0;
+
+    int init, n;
+    if (!constant_value(st, st->phis[k]->args[st->ipre], &init)) return 0;
+    if (test->op == IR_SLTI) n = test->imm;
+    else if (!constant_value(st, test->src2, &n)) return 0;
+    if (init >= n) return 0;
+
+    recurrence_t* r = NULL;
+    for (int c = 0; c < nrecs && !r; c++) {
+        if (recs[c].iv == k && recs[c].every_iteration) r = &recs[c];
+    }
+    long long end = r ? (long long)r->scale * n : 0;
+    if (!r || end > INT_MAX || end < INT_MIN || !only_counts(st, k, test)) return 0;
+
+    char* limit = emit(st, st->pre, IR_LI, NULL, NULL, (int)end);
+    if (r->base) limit = emit(st, st->pre, IR_ADDU, limit, r->base, 0);
+    test->op = IR_SLT;
+    test->src1 = r->ptr;
+    test->src2 = limit;
+    test->imm = 0;
+    return 1;
+}
+
+
+static int reduce_loop(iv_state_t* st, loop_t* l, int* tests) {
+    bb_t* h = l->header;
+    if (h->npreds != 2) return 0;
+    st->pre = NULL;
+    st->latch = NULL;
+    for (int p = 0; p < 2; p++) {
+        if (cfg_dominates(h, h->preds[p])) st->latch = h->preds[p];
+        else st->pre = h->preds[p];
+    }
+    if (!st->pre || !st->latch || st->pre->nsuccs != 1) return 0;  // No preheader
+    st->header = h;
+    st->ipre = cfg_pred_index(h, st->pre);
+    st->ilatch = cfg_pred_index(h, st->latch);
+
+    memset(st->in_loop, 0, st->cfg->nblocks);
+    for (int k = 0; k < l->nblocks; k++) st->in_loop[l->blocks[k]->id] = 1;
+    st->nphis = 0;
+    for (ir_instr_t* i = h->first; i; i = i->next) {
+        if (i->op == IR_PHI) st->phis[st->nphis++] = i;
+    }
+    if (!st->nphis) return 0;
+    find_ivs(st);
+
+    recurrence_t* recs = malloc(st->info->limit * sizeof(recurrence_t));
+    int nrecs = 0;
+    int added = reduce_addresses(st, l, recs, &nrecs);
+    if (added) {  // The rewritten accesses no longer use the counter
+        ssa_free_info(st->info);
+        st->info = ssa_build_info(st->cfg);
+        *tests += replace_test(st, recs, nrecs);
+    }
+    free(recs);
+    return added;
+}
+
+
+int reduce_ivs(cfg_t* cfg, int* tests) {
+    if (!cfg->nloops) return 0;
+    iv_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    st.zero = ir_intern(cfg->func, "$zero");
+    st.in_loop = malloc(cfg->nblocks);
+    int added = 0;
+    for (int k = 0; k < cfg->nloops; k++) {  // Innermost first; each loop sees the pointers of the ones inside
+        st.info = ssa_build_info(cfg);
+        st.nvals = st.info->limit;
+        st.aff = malloc(st.info->limit * sizeof(affine_t));
+        st.phis = malloc(st.info->limit * sizeof(ir_instr_t*));
+        st.steps = malloc(st.info->limit * sizeof(int));
+        added += reduce_loop(&st, cfg->loops[k], tests);
+        free(st.aff);
+        free(st.phis);
+        free(st.steps);
+        ssa_free_info(st.info);
+    }
+    free(st.in_loop);
+    return added;
+}
@@ -0,0 +1,21 @@
+#ifndef IVSR_H
+#define IVSR_H
+
+#include "cfg.h"
+
+
+// Induction-variable strength reduction over SSA, for loops with a preheader (see licm). A basic
+// induction variable is a header phi that the loop advances by a constant step; adds of it, of other
+// adds and of loop-invariant registers give values of the form scale * iv + base + offset. When such
+// a value is the address of a load or store, a new phi holding scale * iv + base takes over: it starts
+// in the preheader, grows by scale * step at the end of the latch, and the offset moves into the
+// access's displacement. Accesses differing only by offset share one pointer.
+//
+// Linear function test replacement then turns the exit test iv < n into pointer < scale * n + base when
+// the counter has no other use left. Only done when the start and n are constants that make the loop
+// run, and the pointer is dereferenced every iteration, so the addresses it takes (below 2^31 on this
+// machine) compare as the counter did. Returns the number of pointers introduced; tests counts the
+// exit tests replaced
+int reduce_ivs(cfg_t* cfg, int* tests);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+
+
+// Largest loop test copied in front of a loop (instructions besides the label)
+#define MAX_ROTATED 8
+
+
+static int loop_contains(loop_t* l, bb_t* b) {
+    for (int k = 0; k < l->nblocks; k++) {
+        if (l->blocks[k] == b) return 1;
+    }
+    return 0;
+}
+
+
+// Guard in front of l: a copy of the header taking over every entry from outside the loop
+static int rotate(cfg_t* cfg, loop_t* l) {
+    bb_t* h = l->header;
+    if (!h->last || !ir_is_cond_branch(h->last->op) || h->nsuccs != 2) return 0;
+    int in0 = loop_contains(l, h->succs[0]);
+    if (in0 == loop_contains(l, h->succs[1]) || h->succs[in0 ? 0 : 1] == h) return 0;  // Not an exit test
+    int n = 0;
+    for (ir_instr_t* i = h->first; i; i = i->next) {
+        if (i->op == IR_JAL || i->op == IR_JALR || i->op == IR_SYSC) return 0;
+        if (i->op != IR_LABEL) n++;
+    }
+    if (n > MAX_ROTATED) return 0;
+    int outside = 0;
+    for (int p = 0; p < h->npreds; p++) outside += !loop_contains(l, h->preds[p]);
+    if (!outside) return 0;
+
+    bb_t* g = cfg_new_block(cfg);
+    for (ir_instr_t* i = h->first; i; i = i->next) {
+        if (i->op == IR_LABEL) continue;
+        ir_instr_t* c = new_ir(cfg->func, i->op, i->dest, i->src1, i->src2, i->imm);
+        c->mem = i->mem;
+        cfg_insert_at_end(g, c);
+    }
+    cfg_add_edge(cfg, g, h->succs[0]);  // Same order: succs[0] is still the taken target
+    cfg_add_edge(cfg, g, h->succs[1]);
+    for (int p = 0; p < h->npreds; ) {
+        if (loop_contains(l, h->preds[p])) p++;
+        else cfg_redirect_edge(cfg, h->preds[p], h, g);  // Removes it from h->preds
+    }
+    return 1;
+}
+
+
+int rotate_loops(cfg_t* cfg) {
+    cfg_analyze(cfg);
+    int rotated = 0;
+    // Outermost first: rotating a loop adds a block to the loops around it, whose block lists are not updated
+    for (int k = cfg->nloops - 1; k >= 0; k--) rotated += rotate(cfg, cfg->loops[k]);
+    if (rotated) cfg_analyze(cfg);
+    return rotated;
+}
+
+
+static void drop_last(bb_t* b) {
+    ir_instr_t* prev = NULL;
+    for (ir_instr_t* i = b->first; i != b->last; i = i->next) prev = i;
+    if (prev) prev->next = NULL;
+    else b->first = NULL;
+    b->last = prev;
+}
+
+
+// Send the predecessors of blocks holding nothing but a label (and a jump) straight to their successor
+static int skip_empty(cfg_t* cfg) {
+    int skipped = 0;
+    for (int k = 1; k < cfg->nblocks; k++) {
+        bb_t* e = cfg->blocks[k];
+        if (e->nsuccs != 1 || e->succs[0] == e || !e->npreds) continue;
+        ir_instr_t* i = e->first;
+        if (i && i->op == IR_LABEL) i = i->next;
+        if (i && !(i == e->last && i->op == IR_J)) continue;
+        bb_t* s = e->succs[0];
+        for (int p = 0; p < e->npreds; ) {
+            bb_t* pred = e->preds[p];
+            int has_s = 0;
+            for (int q = 0; q < pred->nsuccs; q++) has_s |= pred->succs[q] == s;
+            if (has_s) p++;  // A branch whose two sides would be the same block
+            else cfg_redirect_edge(cfg, pred, e, s);
+        }
+        if (e->npreds) continue;
+        cfg_remove_edge(e, s);
+        skipped++;
+    }
+    return skipped;
+}
+
+
+// Append a block's only successor to it when the block is that successor's only predecessor
+static int merge_straight(cfg_t* cfg) {
+    int merged = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* a = cfg->blocks[k];
+        if (k && !a->npreds) continue;
+        while (a->nsuccs == 1) {
+            bb_t* b = a->succs[0];
+            if (b == a || b == cfg->blocks[0] || b->npreds != 1) break;
+            if (a->last && ir_is_cond_branch(a->last->op)) break;
+            if (a->last && a->last->op == IR_J) drop_last(a);
+            ir_instr_t* body = (b->first && b->first->op == IR_LABEL) ? b->first->next : b->first;
+            if (body) {
+                if (a->last) a->last->next = body;
+                else a->first = body;
+                a->last = b->last;
+            }
+            b->first = NULL;
+            b->last = NULL;
+            cfg_remove_edge(a, b);
+            while (b->nsuccs) {
+                bb_t* s = b->succs[0];
+                cfg_remove_edge(b, s);
+                cfg_add_edge(cfg, a, s);
+            }
+            merged++;
+        }
+    }
+    return merged;
+}
+
+
+// Does control reach a return within a few straight-line blocks?
+static int returns_soon(bb_t* b) {
+    for (int step = 0; step < 3 && b; step++) {
+        if (!b->nsuccs) return b->last && b->last->op == IR_JR;
+        b = b->nsuccs == 1 ? b->succs[0] : NULL;
+    }
+    return 0;
+}
+
+
+// Is b only entered from its branch, and does it call a function?
+static int calls_privately(bb_t* b) {
+    if (b->npreds != 1) return 0;
+    for (ir_instr_t* i = b->first; i; i = i->next) {
+        if (i->op == IR_JAL || i->op == IR_JALR) return 1;
+    }
+    return 0;
+}
+
+
+static int stays_in_loop(bb_t* b, bb_t* s) {
+    for (loop_t* l = s->loop; l; l = l->parent) {
+        if (l == b->loop) return 1;
+    }
+    return 0;
+}
+
+
+// Static branch prediction (Ball and Larus): index of the successor a conditional branch probably takes,
+// -1 for no guess. rare is set when the other side is a call or an early return
+static int likely_succ(bb_t* b, int* rare) {
+    *rare = 0;
+    if (b->nsuccs != 2 || !b->last || !ir_is_cond_branch(b->last->op)) return -1;
+    if (b->loop) {  // Loop branch heuristic: iterating is likelier than leaving
+        int in0 = stays_in_loop(b, b->succs[0]);
+        if (in0 != stays_in_loop(b, b->succs[1])) return in0 ? 0 : 1;
+    }
+    int c0 = calls_privately(b->succs[0]);
+    if (c0 != calls_privately(b->succs[1])) {  // Call heuristic: calls sit on the unusual paths
+        *rare = 1;
+        return c0 ? 1 : 0;
+    }
+    switch (b->last->op) {  // Opcode heuristic: values are rarely negative
+        case IR_BLTZ: case IR_BLEZ: return 1;
+        case IR_BGTZ: case IR_BGEZ: return 0;
+        default: break;
+    }
+    int r0 = returns_soon(b->succs[0]);
+    if (r0 != returns_soon(b->succs[1])) {  // Return heuristic
+        *rare = 1;
+        return r0 ? 1 : 0;
+    }
+    return -1;
+}
+
+
+static ir_op_t inverse_branch(ir_op_t op) {
+    switch (op) {
+        case IR_BEQ: return IR_BNE;
+        case IR_BNE: return IR_BEQ;
+        case IR_BLTZ: return IR_BGEZ;
+        case IR_BGEZ: return IR_BLTZ;
+        case IR_BLEZ: return IR_BGTZ;
+        default: return IR_BLEZ;  // IR_BGTZ
+    }
+}
+
+
+// Has every predecessor of c along a forward edge been placed? (cold ones do not count for hot blocks)
+static int preds_placed(bb_t* c, char* placed, char* is_cold) {
+    for (int p = 0; p < c->npreds; p++) {
+        bb_t* pred = c->preds[p];
+        if (pred->rpo < c->rpo && !placed[pred->id] && is_cold[pred->id] == is_cold[c->id]) return 0;
+    }
+    return 1;
+}
+
+
+void layout_blocks(cfg_t* cfg, int* merged, int* cold) {
+    *merged += skip_empty(cfg);
+    *merged += merge_straight(cfg);
+    cfg_analyze(cfg);
+    cfg_remove_unreachable(cfg);
+
+    int n = cfg->nblocks;
+    int* likely = malloc(n * sizeof(int));
+    char* is_cold = calloc(n, 1);
+    char* rare = calloc(n, 1);
+    for (int k = 0; k < n; k++) {
+        int r;
+        likely[k] = likely_succ(cfg->blocks[k], &r);
+        rare[k] = r;
+    }
+    for (int k = 1; k < cfg->nrpo; k++) {  // Cold: entered only from the rare side of a branch or from cold code
+        bb_t* b = cfg->rpo[k];
+        int forward = 0;
+        int all_cold = 1;
+        for (int p = 0; p < b->npreds; p++) {
+            bb_t* pred = b->preds[p];
+            if (pred->rpo >= b->rpo) continue;  // Back edge
+            forward = 1;
+            int rare_edge = rare[pred->id] && pred->succs[1 - likely[pred->id]] == b;
+            if (!is_cold[pred->id] && !rare_edge) all_cold = 0;
+        }
+        is_cold[b->id] = forward && all_cold;
+    }
+
+    // Chains in the original order, hot blocks first: each block is followed by its best unplaced successor
+    // of the same temperature, once everything reaching it from above has been placed (a loop falls out into
+    // its exit right away)
+    bb_t** order = malloc(n * sizeof(bb_t*));
+    char* placed = calloc(n, 1);
+    int norder = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < n; k++) {
+            bb_t* b = cfg->blocks[k];
+            while (b && !placed[b->id] && is_cold[b->id] == pass) {
+                placed[b->id] = 1;
+                order[norder++] = b;
+                bb_t* cand[2] = {NULL, NULL};
+                if (likely[b->id] >= 0) {
+                    cand[0] = b->succs[likely[b->id]];
+                    cand[1] = b->succs[1 - likely[b->id]];
+                } else if (b->nsuccs == 2) {
+                    cand[0] = b->succs[1];  // Keep the fall-through
+                    cand[1] = b->succs[0];
+                } else if (b->nsuccs == 1) {
+                    cand[0] = b->succs[0];
+                }
+                bb_t* next = NULL;
+                for (int c = 0; c < 2 && !next; c++) {
+                    if (cand[c] && !placed[cand[c]->id] && is_cold[cand[c]->id] == pass && (preds_placed(cand[c], placed, is_cold) || (b->loop && !stays_in_loop(b, cand[c])))) next = cand[c];
+                }
+                b = next;
+            }
+        }
+    }
+
+    int last_hot = 0;
+    for (int k = 0; k < n; k++) {
+        if (!is_cold[k]) last_hot = k;
+    }
+    for (int k = 0; k < last_hot; k++) *cold += is_cold[k];
+
+    for (int k = 0; k < n; k++) {
+        cfg->blocks[k] = order[k];
+        order[k]->id = k;
+    }
+    for (int k = 0; k + 1 < n; k++) {  // Fall through to the next block instead of branching to it
+        bb_t* b = cfg->blocks[k];
+        bb_t* next = cfg->blocks[k + 1];
+        if (b->nsuccs != 2 || !b->last || !ir_is_cond_branch(b->last->op) || b->succs[0] != next || b->succs[1] == next) continue;
+        b->last->op = inverse_branch(b->last->op);
+        b->last->dest = b->succs[1]->label;
+        b->succs[0] = b->succs[1];
+        b->succs[1] = next;
+    }
+
+    free(likely);
+    free(is_cold);
+    free(rare);
+    free(order);
+    free(placed);
+}
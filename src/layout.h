@@ -0,0 +1,24 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "cfg.h"
+
+
+// Loop rotation, run after SSA destruction: a loop whose header tests the exit condition gets a copy of
+// the header in front of it as a guard, and the loop's entries go to the guard instead. The header is
+// then only reached from the end of the body, where layout_blocks places it, so each iteration costs
+// one conditional branch back to the top instead of a branch out plus a jump back. Returns the number
+// of loops rotated
+int rotate_loops(cfg_t* cfg);
+
+
+// Static block placement before linearize_cfg. Empty blocks are skipped and straight-line pairs merged,
+// then blocks are chained so each falls through to its likely successor, guessed by static heuristics:
+// staying in the loop, not calling, not taking a branch on a negative value, not returning right away,
+// otherwise the original fall-through. A block reached only from the side of a branch that calls or
+// returns is cold and moves to the end of the function, out of the way of the loop around it.
+// Branches whose target ends up next are inverted. merged and cold count the blocks merged or skipped and
+// the blocks moved out of line
+void layout_blocks(cfg_t* cfg, int* merged, int* cold);
+
+#endif
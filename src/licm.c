@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "licm.h"
+#include "ssa.h"
+
+
+// New block that the header's outside predecessors (outs, each entering once) go through instead. A phi
+// of the header takes their operands from a phi in the new block when they differ
+static bb_t* merge_entries(cfg_t* cfg, bb_t* h, bb_t** outs, int nout) {
+    ir_func_t* f = cfg->func;
+    int nold = h->npreds;
+    bb_t** old = malloc(nold * sizeof(bb_t*));
+    memcpy(old, h->preds, nold * sizeof(bb_t*));
+    bb_t* n = cfg_new_block(cfg);
+    for (int k = 0; k < nout; k++) cfg_redirect_edge(cfg, outs[k], h, n);
+    cfg_add_edge(cfg, n, h);
+    n->rpo = outs[0]->rpo;  // Reachable; licm reanalyzes
+
+    char** merged = malloc(nout * sizeof(char*));
+    for (ir_instr_t* i = h->first; i; i = i->next) {
+        if (i->op == IR_LABEL) continue;
+        if (i->op != IR_PHI) break;
+        int same = 1;
+        for (int k = 0; k < nout; k++) {
+            for (int p = 0; p < nold; p++) {
+                if (old[p] == outs[k]) merged[k] = i->args[p];
+            }
+            same &= merged[k] == merged[0];
+        }
+        char** args = arena_alloc(f->arena, h->npreds * sizeof(char*));
+        for (int p = 0; p < h->npreds; p++) {
+            for (int q = 0; q < nold; q++) {
+                if (old[q] == h->preds[p]) args[p] = i->args[q];
+            }
+        }
+        char* value = merged[0];
+        if (!same) {
+            ir_instr_t* phi = new_ir(f, IR_PHI, new_temp(f), NULL, NULL, 0);
+            phi->nargs = n->npreds;
+            phi->args = arena_alloc(f->arena, n->npreds * sizeof(char*));
+            for (int k = 0; k < nout; k++) phi->args[cfg_pred_index(n, outs[k])] = merged[k];
+            cfg_insert_at_start(n, phi);
+            value = phi->dest;
+        }
+        args[h->npreds - 1] = value;  // n came last
+        i->args = args;
+        i->nargs = h->npreds;
+    }
+    free(merged);
+    free(old);
+    return n;
+}
+
+
+// Block on the one edge entering l's header from outside: split off when the predecessor also goes
+// elsewhere, and made when several predecessors enter
+static bb_t* find_preheader(cfg_t* cfg, loop_t* l, int* added) {
+    bb_t* h = l->header;
+    bb_t** outs = malloc(h->npreds * sizeof(bb_t*));
+    int nout = 0;
+    int twice = 0;  // Some predecessor enters by both sides of a branch
+    for (int p = 0; p < h->npreds; p++) {
+        bb_t* pred = h->preds[p];
+        if (pred->rpo < 0 || cfg_dominates(h, pred)) continue;  // Back edge
+        for (int q = 0; q < nout; q++) twice |= outs[q] == pred;
+        outs[nout++] = pred;
+    }
+    bb_t* pre = NULL;
+    if (twice) {
+        // Left alone: the phis would need one operand per edge
+    } else if (nout == 1 && outs[0]->nsuccs == 1) {
+        pre = outs[0];
+    } else if (nout == 1) {
+        pre = cfg_split_edge(cfg, outs[0], h);
+        (*added)++;
+    } else if (nout > 1) {
+        pre = merge_entries(cfg, h, outs, nout);
+        (*added)++;
+    }
+    free(outs);
+    return pre;
+}
+
+
+// Computations that cannot fault, whatever their operands
+static int is_safe_op(ir_op_t op) {
+    switch (op) {
+        case IR_ADDI: case IR_ADDIU: case IR_SLTI: case IR_SLTIU: case IR_ANDI: case IR_ORI: case IR_XORI:
+        case IR_LUI: case IR_ADD: case IR_ADDU: case IR_SUB: case IR_SUBU: case IR_AND: case IR_OR:
+        case IR_XOR: case IR_NOR: case IR_SLT: case IR_SLTU: case IR_SRL: case IR_LI: case IR_LA:
+        case IR_MOVE: case IR_MUL:
+            return 1;
+        default: return 0;
+    }
+}
+
+
+typedef struct {
+    ssa_info_t* info;
+    char* in_loop;  // By block id
+    bb_t** exits;  // Blocks of the loop with a successor outside it
+    int nexits;
+    ir_instr_t** stores;
+    int nstores;
+    int has_call;
+    char* zero;
+} loop_state_t;
+
+
+static int is_invariant(loop_state_t* st, const char* name) {
+    if (!name || name == st->zero) return 1;
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= st->info->limit) return 0;  // Physical registers change under the loop
+    bb_t* b = st->info->defs[id].block;
+    return b && !st->in_loop[b->id];
+}
+
+
+// Does b run whenever the loop is entered? (it dominates every way out)
+static int always_runs(loop_state_t* st, bb_t* b) {
+    if (!st->nexits) return 0;
+    for (int k = 0; k < st->nexits; k++) {
+        if (!cfg_dominates(b, st->exits[k])) return 0;
+    }
+    return 1;
+}
+
+
+static int can_hoist(loop_state_t* st, ir_instr_t* i, bb_t* b) {
+    char** d = ir_def(i);
+    if (!d || ir_vreg_id(*d) < 0 || i->op == IR_PHI) return 0;
+    char** slots[2];
+    int n = ir_uses(i, slots);
+    for (int s = 0; s < n; s++) {
+        if (!is_invariant(st, *slots[s])) return 0;
+    }
+    if (is_safe_op(i->op)) return 1;
+    if (i->op == IR_DIV || i->op == IR_DIVU) return always_runs(st, b);
+    if (i->op != IR_LW || st->has_call) return 0;
+    for (int k = 0; k < st->nstores; k++) {
+        ir_instr_t* s = st->stores[k];
+        if (s->src1 == i->src1 ? s->imm == i->imm : ir_may_alias(s->mem, i->mem)) return 0;
+    }
+    int id = ir_vreg_id(i->src1);
+    ir_instr_t* base = id >= 0 && id < st->info->limit ? st->info->defs[id].instr : NULL;
+    return (base && base->op == IR_LA) || always_runs(st, b);  // A variable's address is always mapped
+}
+
+
+// Move l's invariant instructions to the end of pre; returns how many moved
+static int hoist_loop(cfg_t* cfg, loop_t* l, bb_t* pre, loop_state_t* st) {
+    memset(st->in_loop, 0, cfg->nblocks);
+    for (int k = 0; k < l->nblocks; k++) st->in_loop[l->blocks[k]->id] = 1;
+    st->nexits = 0;
+    st->nstores = 0;
+    st->has_call = 0;
+    for (int k = 0; k < l->nblocks; k++) {
+        bb_t* b = l->blocks[k];
+        for (int s = 0; s < b->nsuccs; s++) {
+            if (!st->in_loop[b->succs[s]->id]) {
+                st->exits[st->nexits++] = b;
+                break;
+            }
+        }
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (i->op == IR_SW) st->stores[st->nstores++] = i;
+            if (i->op == IR_JAL || i->op == IR_JALR || i->op == IR_SYSC) st->has_call = 1;
+        }
+    }
+
+    int moved = 0;
+    int changed = 1;
+    while (changed) {  // Hoisting a definition can make its users invariant
+        changed = 0;
+        for (int k = 0; k < cfg->nrpo; k++) {
+            bb_t* b = cfg->rpo[k];
+            if (!st->in_loop[b->id]) continue;
+            ir_instr_t* prev = NULL;
+            for (ir_instr_t* i = b->first; i; ) {
+                ir_instr_t* next = i->next;
+                if (i == b->last || !can_hoist(st, i, b)) {
+                    prev = i;
+                    i = next;
+                    continue;
+                }
+                if (prev) prev->next = next;
+                else b->first = next;
+                i->next = NULL;
+                cfg_insert_at_end(pre, i);
+                st->info->defs[ir_vreg_id(*ir_def(i))].block = pre;
+                moved++;
+                changed = 1;
+                i = next;
+            }
+        }
+    }
+    return moved;
+}
+
+
+int licm(cfg_t* cfg, int* preheaders) {
+    if (!cfg->nloops) return 0;
+    int added = 0;
+    for (int k = 0; k < cfg->nloops; k++) find_preheader(cfg, cfg->loops[k], &added);
+    if (added) cfg_analyze(cfg);  // The new blocks belong to the enclosing loops
+    *preheaders += added;
+
+    loop_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.info = ssa_build_info(cfg);
+    st.in_loop = malloc(cfg->nblocks);
+    st.exits = malloc(cfg->nblocks * sizeof(bb_t*));
+    st.zero = ir_intern(cfg->func, "$zero");
+    int nstores = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) nstores += i->op == IR_SW;
+    }
+    st.stores = malloc((nstores ? nstores : 1) * sizeof(ir_instr_t*));
+
+    int moved = 0;
+    for (int k = 0; k < cfg->nloops; k++) {
+        loop_t* l = cfg->loops[k];
+        int none = 0;
+        bb_t* p = find_preheader(cfg, l, &none);  // Split above, so nothing new is added
+        if (p) moved += hoist_loop(cfg, l, p, &st);
+    }
+
+    free(st.in_loop);
+    free(st.exits);
+    free(st.stores);
+    ssa_free_info(st.info);
+    return moved;
+}
@@ -0,0 +1,19 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include "cfg.h"
+
+
+// Loop-invariant code motion over SSA. Each loop gets a preheader: a block on the single edge entering
+// its header from outside, made by splitting that edge when needed. When several blocks enter, they all
+// go through a new block instead, with phis there for the header phi operands that differ between them.
+// Only a loop entered by both sides of one branch goes without. Loops are visited innermost first, and
+// instructions whose operands are all defined outside the loop move to the end of its preheader, from
+// where the enclosing loop can move them further out. Arithmetic (C0 integers wrap) and address
+// computations always move. Divisions and loads could trap, so they only move when their block dominates
+// every exit of the loop (it runs whenever the loop is entered), unless the load's base is the address of
+// a variable. Loads also need a loop with no calls and no store that may alias them. Returns the number
+// of instructions moved; preheaders counts the blocks added
+int licm(cfg_t* cfg, int* preheaders);
+
+#endif
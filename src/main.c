@@ -6,7 +6,13 @@
 #include "scope.h"
 #include "semantic.h"
 #include "IR.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include "opt.h"
 #include "codegen.h"
+#include "regalloc.h"
+#include "frame.h"
+#include "sched.h"
 
 
 int main(int argc, char** argv) {
@@ -14,7 +20,12 @@ int main(int argc, char** argv) {
     int parse_mode = 0;
     int semantic_mode = 0;
     int ir_mode = 0;
+    int cfg_mode = 0;
+    int liveness_mode = 0;
     int codegen_mode = 0;
+    int stats_mode = 0;
+    int opt_level = 0;
+    int regalloc = -1;  // Graph coloring at -O2 and above unless --regalloc picks one
     const char* input_file = NULL;
     const char* output_file = NULL;
 
@@ -27,8 +38,20 @@ int main(int argc, char** argv) {
             semantic_mode = 1;
         } else if (strcmp(argv[i], "--IR") == 0) {
             ir_mode = 1;
+        } else if (strcmp(argv[i], "--dump-cfg") == 0) {
+            cfg_mode = 1;
+        } else if (strcmp(argv[i], "--dump-liveness") == 0) {
+            liveness_mode = 1;
         } else if (strcmp(argv[i], "--codegen") == 0) {
             codegen_mode = 1;
+        } else if (strcmp(argv[i], "--regalloc=linear") == 0) {
+            regalloc = REGALLOC_LINEAR;
+        } else if (strcmp(argv[i], "--regalloc=graph") == 0) {
+            regalloc = REGALLOC_GRAPH;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = 1;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '9' && argv[i][3] == '\0') {
+            opt_level = argv[i][2] - '0';
         } else if (strcmp(argv[i], "-o") == 0) {
             if (++i < argc) {
                 output_file = argv[i];
@@ -40,18 +63,18 @@ int main(int argc, char** argv) {
             input_file = argv[i];
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
-            fprintf(stderr, "Usage: %s [--scan|--parse|--semantic|--IR|--codegen] <input.c0> [-o <output>]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [--scan|--parse|--semantic|--IR|--dump-cfg|--dump-liveness|--codegen] [--stats] [-O<level>] [--regalloc=linear|graph] <input.c0> [-o <output>]\n", argv[0]);
             return 1;
         }
     }
 
     if (!input_file) {
         fprintf(stderr, "Missing input file\n");
-        fprintf(stderr, "Usage: %s [--scan|--parse|--semantic|--IR|--codegen] <input.c0> [-o <output>]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--scan|--parse|--semantic|--IR|--dump-cfg|--dump-liveness|--codegen] [--stats] [-O<level>] [--regalloc=linear|graph] <input.c0> [-o <output>]\n", argv[0]);
         return 1;
     }
 
-    if (!scan_mode && !parse_mode && !semantic_mode && !ir_mode && !codegen_mode) {
+    if (!scan_mode && !parse_mode && !semantic_mode && !ir_mode && !cfg_mode && !liveness_mode && !codegen_mode) {
         codegen_mode = 1;  // Default to full compilation if no mode flags
     }
 
@@ -89,13 +112,53 @@ int main(int argc, char** argv) {
         decl_t* program = parse_program(fp);
         semantic_analyze(program);  // Ensure semantics pass first
         ir_program_t* ir = lower_to_ir(program);
+        optimize_ir(ir, opt_level);
         print_ir(ir);
+        if (stats_mode) {
+            print_ir_stats(stderr);
+            print_opt_stats(stderr);
+        }
+        free_ir(ir);
+        free_decl(program);
+    } else if (cfg_mode) {
+        decl_t* program = parse_program(fp);
+        semantic_analyze(program);
+        ir_program_t* ir = lower_to_ir(program);
+        optimize_ir(ir, opt_level);
+        for (ir_func_t* f = ir->functions; f; f = f->next) {
+            cfg_t* cfg = build_cfg(f);
+            print_cfg(cfg, stdout);
+            linearize_cfg(cfg);
+            free_cfg(cfg);
+        }
+        if (stats_mode) {
+            print_ir_stats(stderr);
+            print_opt_stats(stderr);
+        }
+        free_ir(ir);
+        free_decl(program);
+    } else if (liveness_mode) {
+        decl_t* program = parse_program(fp);
+        semantic_analyze(program);
+        ir_program_t* ir = lower_to_ir(program);
+        optimize_ir(ir, opt_level);
+        for (ir_func_t* f = ir->functions; f; f = f->next) {
+            cfg_t* cfg = build_cfg(f);
+            print_liveness(cfg, stdout);
+            linearize_cfg(cfg);
+            free_cfg(cfg);
+        }
+        if (stats_mode) {
+            print_ir_stats(stderr);
+            print_opt_stats(stderr);
+        }
         free_ir(ir);
         free_decl(program);
     } else if (codegen_mode) {
         decl_t* program = parse_program(fp);
         semantic_analyze(program);  // Ensure semantics pass first
         ir_program_t* ir = lower_to_ir(program);
+        optimize_ir(ir, opt_level);
 
         FILE* out = stdout;
         if (output_file) {
@@ -120,9 +183,17 @@ int main(int argc, char** argv) {
             }
         }
 
-        gen_code(ir, out);
+        if (regalloc < 0) regalloc = opt_level >= 2 ? REGALLOC_GRAPH : REGALLOC_LINEAR;
+        gen_code(ir, out, regalloc, opt_level >= 1);
 
         if (out != stdout) fclose(out);
+        if (stats_mode) {
+            print_ir_stats(stderr);
+            print_opt_stats(stderr);
+            print_regalloc_stats(stderr);
+            print_frame_stats(stderr);
+            print_sched_stats(stderr);
+        }
         free_ir(ir);
         free_decl(program);
     }
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "opt.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "sccp.h"
+#include "copyprop.h"
+#include "strength.h"
+#include "cse.h"
+#include "dce.h"
+#include "licm.h"
+#include "layout.h"
+#include "unroll.h"
+#include "ivsr.h"
+#include "regalloc.h"
+
+
+// Counters for --stats
+static int opt_ran = 0;
+static int copies_propagated = 0;
+static int moves_coalesced = 0;
+static int strength_reduced = 0;
+static int cse_instrs = 0;
+static int loads_removed = 0;
+static int dead_stores = 0;
+static int licm_hoisted = 0;
+static int licm_preheaders = 0;
+static int loops_unrolled = 0;
+static int loops_fully_unrolled = 0;
+static int ivs_reduced = 0;
+static int ivs_tests = 0;
+static int loops_rotated = 0;
+static int blocks_merged = 0;
+static int cold_blocks = 0;
+static int dce_instrs = 0;
+static int dce_funcs = 0;
+static int dce_globals = 0;
+
+
+// The SSA-based passes, from constant propagation to coalescing the moves left by SSA destruction. ivs
+// enables induction-variable strength reduction, kept for the last round so unrolling still sees counters
+static void ssa_passes(cfg_t* cfg, int level, int ivs) {
+    sccp(cfg);
+    copies_propagated += copyprop(cfg);
+    strength_reduced += strength_reduce(cfg);
+    cse_instrs += cse(cfg, level >= 2, &loads_removed);  // Dominator-scoped at -O2, per block at -O1
+    dead_stores += dse(cfg);
+    if (level >= 2) licm_hoisted += licm(cfg, &licm_preheaders);
+    if (ivs) ivs_reduced += reduce_ivs(cfg, &ivs_tests);
+    dce_instrs += dce(cfg);
+    ssa_destruct(cfg);
+    moves_coalesced += coalesce_moves(cfg);
+}
+
+
+static void optimize_func(ir_func_t* f, int level) {
+    cfg_t* cfg = build_cfg(f);
+
+    ssa_construct(cfg);
+    ssa_passes(cfg, level, 0);
+    if (level >= 2) {  // Again, to fold what unrolled copies know and reduce what the loops index with
+        loops_unrolled += unroll_loops(cfg, &loops_fully_unrolled);
+        ssa_reconstruct(cfg);
+        ssa_passes(cfg, level, 1);
+        loops_rotated += rotate_loops(cfg);
+    }
+    layout_blocks(cfg, &blocks_merged, &cold_blocks);
+
+    linearize_cfg(cfg);
+    free_cfg(cfg);
+}
+
+
+void optimize_ir(ir_program_t* ir, int level) {
+    if (level >= 1) {
+        opt_ran = 1;
+        for (ir_func_t* f = ir->functions; f; f = f->next) optimize_func(f, level);
+        dce_program(ir, &dce_funcs, &dce_globals);
+    }
+    for (ir_func_t* f = ir->functions; f; f = f->next) expand_mul_div(f);  // Whatever is left calls the runtime
+}
+
+
+void print_opt_stats(FILE* out) {
+    if (!opt_ran) return;
+    fprintf(out, "Copies: %d propagated, %d moves coalesced\n", copies_propagated, moves_coalesced);
+    fprintf(out, "Strength reduction: %d multiplies/divides by constants rewritten\n", strength_reduced);
+    fprintf(out, "CSE: %d instructions removed\n", cse_instrs);
+    fprintf(out, "Memory: %d loads reused or forwarded from a store, %d dead stores removed\n", loads_removed, dead_stores);
+    fprintf(out, "LICM: %d instructions hoisted, %d preheaders added\n", licm_hoisted, licm_preheaders);
+    fprintf(out, "Unrolling: %d loops unrolled, %d of them completely\n", loops_unrolled, loops_fully_unrolled);
+    fprintf(out, "Induction variables: %d address computations strength reduced, %d loop tests replaced\n", ivs_reduced, ivs_tests);
+    fprintf(out, "Layout: %d loops rotated, %d blocks merged or skipped, %d cold blocks moved to the end\n", loops_rotated, blocks_merged, cold_blocks);
+    fprintf(out, "DCE: %d instructions, %d functions, %d globals removed\n", dce_instrs, dce_funcs, dce_globals);
+}
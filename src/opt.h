@@ -0,0 +1,14 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "IR.h"
+
+
+// Run the IR optimization pipeline for the given -O level (0 only turns mul/div into runtime calls)
+void optimize_ir(ir_program_t* ir, int level);
+
+
+// What the passes removed or rewrote (--stats)
+void print_opt_stats(FILE* out);
+
+#endif
@@ -101,6 +101,8 @@ expr_t* expr_create(expr_kind_t kind, expr_t* left, expr_t* right) {
     e->char_val = 0;
     e->bool_val = false;
     e->next = NULL;
+    e->regs = -1;
+    e->pure = false;
     return e;
 }
 
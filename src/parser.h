@@ -81,6 +81,8 @@ struct expr {
     char char_val;
     bool bool_val;
     expr_t* next;
+    int regs;  // Sethi-Ullman number, set while lowering (-1 until then)
+    bool pure;  // No calls or allocations anywhere below, set with regs
 };
 
 
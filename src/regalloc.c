@@ -0,0 +1,952 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regalloc.h"
+#include "dataflow.h"
+
+
+static void vreg_uses(ir_instr_t* i, int* ids, int* n) {
+    char** slots[2];
+    int k = ir_uses(i, slots);
+    *n = 0;
+    for (int s = 0; s < k; s++) {
+        int id = ir_vreg_id(*slots[s]);
+        if (id >= 0) ids[(*n)++] = id;
+    }
+}
+
+
+static int vreg_def(ir_instr_t* i) {
+    char** d = ir_def(i);
+    return d ? ir_vreg_id(*d) : -1;
+}
+
+
+// Interference graph: a hash set of edges for queries plus adjacency lists for merging nodes
+typedef struct {
+    unsigned long long* edges;  // (min << 32 | max) + 1, 0 = empty slot
+    int cap;
+    int count;
+    int** adj;
+    int* nadj;
+    int* adj_cap;
+} igraph_t;
+
+
+static unsigned long long edge_key(int a, int b) {
+    if (a > b) {
+        int t = a;
+        a = b;
+        b = t;
+    }
+    return (((unsigned long long)a << 32) | (unsigned)b) + 1;
+}
+
+
+static unsigned edge_slot(igraph_t* g, unsigned long long key) {
+    unsigned long long h = key * 0x9E3779B97F4A7C15ull;
+    return (unsigned)(h >> 32) & (g->cap - 1);
+}
+
+
+static int has_edge(igraph_t* g, int a, int b) {
+    unsigned long long key = edge_key(a, b);
+    for (unsigned s = edge_slot(g, key); g->edges[s]; s = (s + 1) & (g->cap - 1)) {
+        if (g->edges[s] == key) return 1;
+    }
+    return 0;
+}
+
+
+static void adj_push(igraph_t* g, int a, int b) {
+    if (g->nadj[a] == g->adj_cap[a]) {
+        g->adj_cap[a] = g->adj_cap[a] ? g->adj_cap[a] * 2 : 4;
+        g->adj[a] = realloc(g->adj[a], g->adj_cap[a] * sizeof(int));
+    }
+    g->adj[a][g->nadj[a]++] = b;
+}
+
+
+static void add_edge(igraph_t* g, int a, int b) {
+    if (a == b || has_edge(g, a, b)) return;
+    if (2 * (g->count + 1) > g->cap) {
+        unsigned long long* old = g->edges;
+        int old_cap = g->cap;
+        g->cap *= 2;
+        g->edges = calloc(g->cap, sizeof(unsigned long long));
+        for (int k = 0; k < old_cap; k++) {
+            if (!old[k]) continue;
+            unsigned s = edge_slot(g, old[k]);
+            while (g->edges[s]) s = (s + 1) & (g->cap - 1);
+            g->edges[s] = old[k];
+        }
+        free(old);
+    }
+    unsigned long long key = edge_key(a, b);
+    unsigned s = edge_slot(g, key);
+    while (g->edges[s]) s = (s + 1) & (g->cap - 1);
+    g->edges[s] = key;
+    g->count++;
+    adj_push(g, a, b);
+    adj_push(g, b, a);
+}
+
+
+static void build_interference(cfg_t* cfg, dataflow_t* lv, igraph_t* g, int limit) {
+    sparse_set_t* live = sparse_set_new(limit);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        sparse_set_from_bits(live, lv->out[k]);
+        int n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) n++;
+        ir_instr_t** instrs = malloc((n ? n : 1) * sizeof(ir_instr_t*));
+        n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) instrs[n++] = i;
+
+        for (int x = n - 1; x >= 0; x--) {
+            ir_instr_t* i = instrs[x];
+            int d = vreg_def(i);
+            if (d >= 0) {
+                // The source of a copy may share the destination's register: that is what coalescing is for
+                int copy_src = i->op == IR_MOVE ? ir_vreg_id(i->src1) : -1;
+                for (int m = 0; m < live->n; m++) {
+                    if (live->dense[m] != copy_src) add_edge(g, d, live->dense[m]);
+                }
+                sparse_set_remove(live, d);
+            }
+            int ids[2];
+            int nu;
+            vreg_uses(i, ids, &nu);
+            for (int s = 0; s < nu; s++) sparse_set_add(live, ids[s]);
+        }
+        free(instrs);
+    }
+    sparse_set_free(live);
+}
+
+
+static int find(int* parent, int k) {
+    while (parent[k] != k) {
+        parent[k] = parent[parent[k]];
+        k = parent[k];
+    }
+    return k;
+}
+
+
+int coalesce_moves(cfg_t* cfg) {
+    int limit = cfg_vreg_limit(cfg);
+    if (limit == 0) return 0;
+    char** names = calloc(limit, sizeof(char*));
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            int d = vreg_def(i);
+            if (d >= 0) names[d] = *ir_def(i);
+        }
+    }
+
+    dataflow_t* lv = compute_liveness(cfg, limit);
+    igraph_t g;
+    g.cap = 64;
+    g.count = 0;
+    g.edges = calloc(g.cap, sizeof(unsigned long long));
+    g.adj = calloc(limit, sizeof(int*));
+    g.nadj = calloc(limit, sizeof(int));
+    g.adj_cap = calloc(limit, sizeof(int));
+    build_interference(cfg, lv, &g, limit);
+    dataflow_free(lv);
+
+    int* parent = malloc(limit * sizeof(int));
+    for (int k = 0; k < limit; k++) parent[k] = k;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            if (i->op != IR_MOVE) continue;
+            int a = ir_vreg_id(i->dest);
+            int b = ir_vreg_id(i->src1);
+            if (a < 0 || b < 0 || !names[a] || !names[b]) continue;
+            a = find(parent, a);
+            b = find(parent, b);
+            if (a == b || has_edge(&g, a, b)) continue;
+            parent[b] = a;
+            for (int e = 0; e < g.nadj[b]; e++) add_edge(&g, a, find(parent, g.adj[b][e]));
+        }
+    }
+
+    int removed = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            char** slots[3];
+            int n = ir_uses(i, slots);
+            char** d = ir_def(i);
+            if (d) slots[n++] = d;
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id >= 0 && names[find(parent, id)]) *slots[s] = names[find(parent, id)];
+            }
+            if (i->op == IR_MOVE && i->dest == i->src1) {
+                if (prev) prev->next = next;
+                else b->first = next;
+                if (b->last == i) b->last = prev;
+                removed++;
+            } else {
+                prev = i;
+            }
+            i = next;
+        }
+    }
+
+    for (int k = 0; k < limit; k++) free(g.adj[k]);
+    free(g.adj);
+    free(g.nadj);
+    free(g.adj_cap);
+    free(g.edges);
+    free(parent);
+    free(names);
+    return removed;
+}
+
+
+// Allocatable registers: caller-saved $t first, then callee-saved $s. $at and $v1 are kept free as
+// scratch for spill code; $a0-$a3 and $v0 only appear where the IR names them
+#define NUM_T_REGS 10
+#define NUM_S_REGS 8
+#define NUM_REGS (NUM_T_REGS + NUM_S_REGS)
+
+static const char* const reg_names[NUM_REGS] = {
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$t8", "$t9",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7"
+};
+
+
+// Counters for --stats
+static int ra_intervals = 0;
+static int ra_spilled = 0;
+static int ra_spill_instrs = 0;
+static int ra_code_size = 0;
+
+
+static int is_callee_saved(int reg) {
+    return reg >= NUM_T_REGS;
+}
+
+
+// Live interval of a virtual register over instruction positions: instruction n reads its operands at
+// 2n and writes its result at 2n + 1, so a value may take the register of an operand read by its own
+// definition. Intervals have no holes (Poletto and Sarkar)
+typedef struct {
+    int vreg;
+    int start;
+    int end;
+    int crosses_call;  // A call clobbers caller-saved registers while the value is live
+    int reg;  // Index into reg_names, -1 when spilled
+    int slot;  // Spill slot when spilled
+} interval_t;
+
+
+static int by_start(const void* a, const void* b) {
+    const interval_t* x = *(interval_t* const*)a;
+    const interval_t* y = *(interval_t* const*)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->vreg - y->vreg;
+}
+
+
+static int is_call(ir_op_t op) {
+    return op == IR_JAL || op == IR_JALR || op == IR_SYSC;
+}
+
+
+static void extend(interval_t* iv, int pos) {
+    if (pos < iv->start) iv->start = pos;
+    if (pos > iv->end) iv->end = pos;
+}
+
+
+// Positions and call sites in layout order; returns the intervals of every vreg that occurs
+static interval_t* build_intervals(cfg_t* cfg, int limit, int** calls_out, int* ncalls_out) {
+    dataflow_t* lv = compute_liveness(cfg, limit);
+    interval_t* ivs = malloc(limit * sizeof(interval_t));
+    for (int v = 0; v < limit; v++) {
+        ivs[v].vreg = v;
+        ivs[v].start = 0x7fffffff;
+        ivs[v].end = -1;
+        ivs[v].crosses_call = 0;
+        ivs[v].reg = -1;
+        ivs[v].slot = -1;
+    }
+    int* calls = NULL;
+    int ncalls = 0;
+    int calls_cap = 0;
+
+    int n = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        int first = n;
+        for (ir_instr_t* i = b->first; i; i = i->next, n++) {
+            int ids[2];
+            int nu;
+            vreg_uses(i, ids, &nu);
+            for (int s = 0; s < nu; s++) extend(&ivs[ids[s]], 2 * n);
+            int d = vreg_def(i);
+            if (d >= 0) extend(&ivs[d], 2 * n + 1);
+            if (is_call(i->op)) {
+                if (ncalls == calls_cap) {
+                    calls_cap = calls_cap ? calls_cap * 2 : 16;
+                    calls = realloc(calls, calls_cap * sizeof(int));
+                }
+                calls[ncalls++] = 2 * n + 1;
+            }
+        }
+        if (n == first) continue;  // Empty block: its neighbours' positions cover whatever flows through
+        for (int w = 0; w < lv->nwords; w++) {
+            for (word_t bits = lv->in[k][w]; bits; bits &= bits - 1) {
+                int v = w * WORD_BITS + __builtin_ctzll(bits);
+                if (v < limit) extend(&ivs[v], 2 * first);
+            }
+            for (word_t bits = lv->out[k][w]; bits; bits &= bits - 1) {
+                int v = w * WORD_BITS + __builtin_ctzll(bits);
+                if (v < limit) extend(&ivs[v], 2 * n - 1);
+            }
+        }
+    }
+    dataflow_free(lv);
+    *calls_out = calls;
+    *ncalls_out = ncalls;
+    return ivs;
+}
+
+
+// Does a call fall strictly inside the interval? (calls is sorted)
+static int crosses_call(interval_t* iv, int* calls, int ncalls) {
+    int lo = 0;
+    int hi = ncalls;
+    while (lo < hi) {  // First call after the start
+        int mid = (lo + hi) / 2;
+        if (calls[mid] <= iv->start) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < ncalls && calls[lo] < iv->end;
+}
+
+
+// Rewrite operands to the assigned registers; spilled values are reloaded into $at/$v1 before each use
+// and stored from $at after each definition
+static void rewrite(cfg_t* cfg, interval_t* ivs, int limit) {
+    ir_func_t* f = cfg->func;
+    char* names[NUM_REGS];
+    for (int r = 0; r < NUM_REGS; r++) names[r] = ir_intern(f, reg_names[r]);
+    char* scratch[2] = { ir_intern(f, "$at"), ir_intern(f, "$v1") };
+    char* sp = ir_intern(f, "$sp");
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            char** slots[2];
+            int nu = ir_uses(i, slots);
+            int loaded[2] = { -1, -1 };
+            for (int s = 0; s < nu; s++) {
+                int v = ir_vreg_id(*slots[s]);
+                if (v < 0 || v >= limit) continue;
+                if (ivs[v].reg >= 0) {
+                    *slots[s] = names[ivs[v].reg];
+                    continue;
+                }
+                if (s == 1 && loaded[0] == v) {  // Same spilled value in both operands: one reload
+                    *slots[s] = scratch[0];
+                    continue;
+                }
+                ir_instr_t* reload = new_ir(f, IR_LW, scratch[s], sp, NULL, f->spill_base + 4 * ivs[v].slot);
+                reload->next = i;
+                if (prev) prev->next = reload;
+                else b->first = reload;
+                prev = reload;
+                *slots[s] = scratch[s];
+                loaded[s] = v;
+                ra_spill_instrs++;
+            }
+            char** d = ir_def(i);
+            int v = d ? ir_vreg_id(*d) : -1;
+            if (v >= 0 && v < limit) {
+                if (ivs[v].reg >= 0) {
+                    *d = names[ivs[v].reg];
+                } else {
+                    *d = scratch[0];
+                    ir_instr_t* store = new_ir(f, IR_SW, scratch[0], sp, NULL, f->spill_base + 4 * ivs[v].slot);
+                    store->next = next;
+                    i->next = store;
+                    if (b->last == i) b->last = store;
+                    ra_spill_instrs++;
+                }
+            }
+            if (i->op == IR_MOVE && i->dest == i->src1) {  // Both ends got the same register
+                if (prev) prev->next = i->next;
+                else b->first = i->next;
+                if (b->last == i) b->last = prev;
+                i = i->next;
+                continue;
+            }
+            prev = i;
+            i = i->next;
+        }
+    }
+}
+
+
+// Stack slot coloring for spills: the lowest slot no spilled interval overlapping iv holds, so values
+// that are never live together share one
+static int spill_slot(ir_func_t* f, interval_t* iv, interval_t** spilled, int nspilled) {
+    char* used = calloc(f->spill_slots + 1, 1);
+    for (int k = 0; k < nspilled; k++) {
+        if (spilled[k]->start <= iv->end && iv->start <= spilled[k]->end) used[spilled[k]->slot] = 1;
+    }
+    int slot = 0;
+    while (slot < f->spill_slots && used[slot]) slot++;
+    free(used);
+    if (slot == f->spill_slots) f->spill_slots++;
+    else f->slot_savings += 4;
+    return slot;
+}
+
+
+// Linear scan over intervals sorted by start. Values live across a call need a callee-saved register;
+// the others prefer caller-saved ones. When nothing is free, the interval ending last (among those whose
+// register would do) is spilled
+static void linear_scan(interval_t** sorted, int n, ir_func_t* f) {
+    interval_t* active[NUM_REGS];  // Sorted by end
+    int nactive = 0;
+    int free_reg[NUM_REGS];
+    for (int r = 0; r < NUM_REGS; r++) free_reg[r] = 1;
+    interval_t** spilled = malloc((n ? n : 1) * sizeof(interval_t*));
+    int nspilled = 0;
+
+    for (int k = 0; k < n; k++) {
+        interval_t* cur = sorted[k];
+        int expired = 0;
+        for (int a = 0; a < nactive; a++) {
+            if (active[a]->end < cur->start) {
+                free_reg[active[a]->reg] = 1;
+                expired++;
+            } else {
+                active[a - expired] = active[a];
+            }
+        }
+        nactive -= expired;
+
+        int reg = -1;
+        for (int r = cur->crosses_call ? NUM_T_REGS : 0; r < NUM_REGS && reg < 0; r++) {
+            if (free_reg[r]) reg = r;
+        }
+        if (reg < 0) {
+            int victim = -1;
+            for (int a = nactive - 1; a >= 0 && victim < 0; a--) {
+                if (!cur->crosses_call || is_callee_saved(active[a]->reg)) victim = a;
+            }
+            if (victim >= 0 && active[victim]->end > cur->end) {
+                interval_t* spill = active[victim];
+                reg = spill->reg;
+                spill->reg = -1;
+                spill->slot = spill_slot(f, spill, spilled, nspilled);
+                spilled[nspilled++] = spill;
+                for (int a = victim; a + 1 < nactive; a++) active[a] = active[a + 1];
+                nactive--;
+            } else {
+                cur->slot = spill_slot(f, cur, spilled, nspilled);
+                spilled[nspilled++] = cur;
+                ra_spilled++;
+                continue;
+            }
+            ra_spilled++;
+        }
+        cur->reg = reg;
+        free_reg[reg] = 0;
+        if (is_callee_saved(reg)) f->saved_regs |= 1u << (reg - NUM_T_REGS);
+        int pos = nactive++;
+        while (pos > 0 && active[pos - 1]->end > cur->end) {
+            active[pos] = active[pos - 1];
+            pos--;
+        }
+        active[pos] = cur;
+    }
+    free(spilled);
+}
+
+
+// Iterated register coalescing (George and Appel): nodes 0 .. NUM_REGS-1 are the precolored machine
+// registers, node NUM_REGS + v is vreg v. A call interferes every value live across it with the
+// caller-saved registers, so those values end up in $s registers or spilled
+enum { NODE_NONE, NODE_PRECOLORED, NODE_INITIAL, NODE_SIMPLIFY, NODE_FREEZE, NODE_SPILL, NODE_SPILLED,
+       NODE_COALESCED, NODE_COLORED, NODE_SELECT };
+enum { MOVE_WORKLIST, MOVE_ACTIVE, MOVE_COALESCED, MOVE_CONSTRAINED, MOVE_FROZEN };
+
+typedef struct {
+    int x;  // Destination node
+    int y;  // Source node
+    int state;
+} irc_move_t;
+
+typedef struct {
+    int n;  // Nodes
+    igraph_t g;
+    int* degree;
+    int* state;
+    int* alias;
+    int* color;
+    double* cost;  // Spill cost: occurrences weighted by 10^loop depth
+    int** move_list;  // Moves each node takes part in
+    int* nmove_list;
+    int* move_list_cap;
+    irc_move_t* moves;
+    int nmoves;
+    int* worklist;  // Simplify, freeze and spill worklists are stacks with lazy deletion: an entry
+    int nworklist;  // counts only while the node's state still matches
+    int worklist_cap;
+    int* freeze_list;
+    int nfreeze;
+    int freeze_cap;
+    int* spill_list;
+    int nspill;
+    int spill_cap;
+    int* move_work;  // Moves in MOVE_WORKLIST
+    int nmove_work;
+    int move_work_cap;
+    int* select;
+    int nselect;
+    int* mark;  // Scratch for the conservative test
+    int mark_gen;
+} irc_t;
+
+
+static int irc_precolored(irc_t* r, int n) {
+    return r->state[n] == NODE_PRECOLORED;
+}
+
+
+static void irc_push(int** list, int* n, int* cap, int x) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 8;
+        *list = realloc(*list, *cap * sizeof(int));
+    }
+    (*list)[(*n)++] = x;
+}
+
+
+static void irc_add_edge(irc_t* r, int u, int v) {
+    if (u == v || has_edge(&r->g, u, v)) return;
+    add_edge(&r->g, u, v);
+    if (!irc_precolored(r, u)) r->degree[u]++;
+    if (!irc_precolored(r, v)) r->degree[v]++;
+}
+
+
+static void irc_add_move(irc_t* r, int node, int m) {
+    irc_push(&r->move_list[node], &r->nmove_list[node], &r->move_list_cap[node], m);
+}
+
+
+static int irc_move_related(irc_t* r, int n) {
+    for (int k = 0; k < r->nmove_list[n]; k++) {
+        int st = r->moves[r->move_list[n][k]].state;
+        if (st == MOVE_WORKLIST || st == MOVE_ACTIVE) return 1;
+    }
+    return 0;
+}
+
+
+// Put a node on the worklist its degree and moves call for
+static void irc_classify(irc_t* r, int n) {
+    if (r->degree[n] >= NUM_REGS) {
+        r->state[n] = NODE_SPILL;
+        irc_push(&r->spill_list, &r->nspill, &r->spill_cap, n);
+    } else if (irc_move_related(r, n)) {
+        r->state[n] = NODE_FREEZE;
+        irc_push(&r->freeze_list, &r->nfreeze, &r->freeze_cap, n);
+    } else {
+        r->state[n] = NODE_SIMPLIFY;
+        irc_push(&r->worklist, &r->nworklist, &r->worklist_cap, n);
+    }
+}
+
+
+static int irc_adjacent(irc_t* r, int n, int k) {  // Neighbour k of n, or -1 if it is off the graph
+    int m = r->g.adj[n][k];
+    return (r->state[m] == NODE_SELECT || r->state[m] == NODE_COALESCED) ? -1 : m;
+}
+
+
+static void irc_enable_moves(irc_t* r, int n) {
+    for (int k = 0; k < r->nmove_list[n]; k++) {
+        int m = r->move_list[n][k];
+        if (r->moves[m].state == MOVE_ACTIVE) {
+            r->moves[m].state = MOVE_WORKLIST;
+            irc_push(&r->move_work, &r->nmove_work, &r->move_work_cap, m);
+        }
+    }
+}
+
+
+static void irc_decrement_degree(irc_t* r, int m) {
+    if (irc_precolored(r, m)) return;
+    if (r->degree[m]-- != NUM_REGS) return;
+    irc_enable_moves(r, m);
+    for (int k = 0; k < r->g.nadj[m]; k++) {
+        int a = irc_adjacent(r, m, k);
+        if (a >= 0) irc_enable_moves(r, a);
+    }
+    if (r->state[m] == NODE_SPILL) irc_classify(r, m);
+}
+
+
+static int irc_alias(irc_t* r, int n) {
+    while (r->state[n] == NODE_COALESCED) n = r->alias[n];
+    return n;
+}
+
+
+static void irc_add_worklist(irc_t* r, int u) {
+    if (!irc_precolored(r, u) && !irc_move_related(r, u) && r->degree[u] < NUM_REGS && r->state[u] == NODE_FREEZE) {
+        r->state[u] = NODE_SIMPLIFY;
+        irc_push(&r->worklist, &r->nworklist, &r->worklist_cap, u);
+    }
+}
+
+
+// George: every significant neighbour of v already interferes with precolored u
+static int irc_george(irc_t* r, int u, int v) {
+    for (int k = 0; k < r->g.nadj[v]; k++) {
+        int t = irc_adjacent(r, v, k);
+        if (t < 0) continue;
+        if (!(r->degree[t] < NUM_REGS || irc_precolored(r, t) || has_edge(&r->g, t, u))) return 0;
+    }
+    return 1;
+}
+
+
+// Briggs: the merged node has fewer than K significant neighbours
+static int irc_briggs(irc_t* r, int u, int v) {
+    r->mark_gen++;
+    int significant = 0;
+    int nodes[2] = { u, v };
+    for (int x = 0; x < 2; x++) {
+        for (int k = 0; k < r->g.nadj[nodes[x]]; k++) {
+            int t = irc_adjacent(r, nodes[x], k);
+            if (t < 0 || r->mark[t] == r->mark_gen) continue;
+            r->mark[t] = r->mark_gen;
+            if (irc_precolored(r, t) || r->degree[t] >= NUM_REGS) significant++;
+        }
+    }
+    return significant < NUM_REGS;
+}
+
+
+static void irc_combine(irc_t* r, int u, int v) {
+    r->state[v] = NODE_COALESCED;  // Drops v from the freeze or spill worklist
+    r->alias[v] = u;
+    for (int k = 0; k < r->nmove_list[v]; k++) irc_add_move(r, u, r->move_list[v][k]);
+    irc_enable_moves(r, v);
+    for (int k = 0; k < r->g.nadj[v]; k++) {
+        int t = irc_adjacent(r, v, k);
+        if (t < 0) continue;
+        irc_add_edge(r, t, u);
+        irc_decrement_degree(r, t);
+    }
+    if (r->degree[u] >= NUM_REGS && r->state[u] == NODE_FREEZE) {
+        r->state[u] = NODE_SPILL;
+        irc_push(&r->spill_list, &r->nspill, &r->spill_cap, u);
+    }
+}
+
+
+static void irc_coalesce(irc_t* r, int m) {
+    int x = irc_alias(r, r->moves[m].x);
+    int y = irc_alias(r, r->moves[m].y);
+    int u = irc_precolored(r, y) ? y : x;
+    int v = irc_precolored(r, y) ? x : y;
+    if (u == v) {
+        r->moves[m].state = MOVE_COALESCED;
+        irc_add_worklist(r, u);
+    } else if (irc_precolored(r, v) || has_edge(&r->g, u, v)) {
+        r->moves[m].state = MOVE_CONSTRAINED;
+        irc_add_worklist(r, u);
+        irc_add_worklist(r, v);
+    } else if (irc_precolored(r, u) ? irc_george(r, u, v) : irc_briggs(r, u, v)) {
+        r->moves[m].state = MOVE_COALESCED;
+        irc_combine(r, u, v);
+        irc_add_worklist(r, u);
+    } else {
+        r->moves[m].state = MOVE_ACTIVE;
+    }
+}
+
+
+static void irc_freeze_moves(irc_t* r, int u) {
+    for (int k = 0; k < r->nmove_list[u]; k++) {
+        irc_move_t* mv = &r->moves[r->move_list[u][k]];
+        if (mv->state != MOVE_WORKLIST && mv->state != MOVE_ACTIVE) continue;
+        int v = irc_alias(r, mv->y) == irc_alias(r, u) ? irc_alias(r, mv->x) : irc_alias(r, mv->y);
+        mv->state = MOVE_FROZEN;
+        if (r->state[v] == NODE_FREEZE && !irc_move_related(r, v) && r->degree[v] < NUM_REGS) {
+            r->state[v] = NODE_SIMPLIFY;
+            irc_push(&r->worklist, &r->nworklist, &r->worklist_cap, v);
+        }
+    }
+}
+
+
+static void irc_build(irc_t* r, cfg_t* cfg, int limit) {
+    dataflow_t* lv = compute_liveness(cfg, limit);
+    sparse_set_t* live = sparse_set_new(limit);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        double weight = 1;
+        for (int d = 0; d < b->loop_depth && d < 8; d++) weight *= 10;
+        int n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) n++;
+        ir_instr_t** instrs = malloc((n ? n : 1) * sizeof(ir_instr_t*));
+        n = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) instrs[n++] = i;
+
+        sparse_set_from_bits(live, lv->out[k]);
+        for (int x = n - 1; x >= 0; x--) {
+            ir_instr_t* i = instrs[x];
+            int ids[2];
+            int nu;
+            vreg_uses(i, ids, &nu);
+            int d = vreg_def(i);
+            for (int s = 0; s < nu; s++) r->cost[NUM_REGS + ids[s]] += weight;
+            if (d >= 0) r->cost[NUM_REGS + d] += weight;
+
+            if (i->op == IR_MOVE && d >= 0 && nu == 1) {  // A copy: source and destination may share
+                sparse_set_remove(live, ids[0]);
+                int m = r->nmoves++;
+                r->moves[m].x = NUM_REGS + d;
+                r->moves[m].y = NUM_REGS + ids[0];
+                r->moves[m].state = MOVE_WORKLIST;
+                irc_add_move(r, NUM_REGS + d, m);
+                irc_add_move(r, NUM_REGS + ids[0], m);
+                irc_push(&r->move_work, &r->nmove_work, &r->move_work_cap, m);
+            }
+            if (is_call(i->op)) {  // Caller-saved registers die here
+                for (int m = 0; m < live->n; m++) {
+                    for (int reg = 0; reg < NUM_T_REGS; reg++) irc_add_edge(r, reg, NUM_REGS + live->dense[m]);
+                }
+            }
+            if (d >= 0) {
+                for (int m = 0; m < live->n; m++) irc_add_edge(r, NUM_REGS + live->dense[m], NUM_REGS + d);
+                sparse_set_remove(live, d);
+            }
+            for (int s = 0; s < nu; s++) sparse_set_add(live, ids[s]);
+        }
+        free(instrs);
+    }
+    sparse_set_free(live);
+    dataflow_free(lv);
+}
+
+
+// Stack slot coloring for spills: the lowest slot held by no spilled neighbour of n in the interference
+// graph (neighbours not given one yet are skipped)
+static int irc_spill_slot(irc_t* r, int n, interval_t* ivs, ir_func_t* f) {
+    char* used = calloc(f->spill_slots + 1, 1);
+    for (int k = 0; k < r->g.nadj[n]; k++) {
+        int w = irc_alias(r, r->g.adj[n][k]);
+        if (w >= NUM_REGS && r->state[w] == NODE_SPILLED && ivs[w - NUM_REGS].slot >= 0) used[ivs[w - NUM_REGS].slot] = 1;
+    }
+    int slot = 0;
+    while (slot < f->spill_slots && used[slot]) slot++;
+    free(used);
+    if (slot == f->spill_slots) f->spill_slots++;
+    else f->slot_savings += 4;
+    return slot;
+}
+
+
+static void graph_color(cfg_t* cfg, int limit, interval_t* ivs) {
+    irc_t r;
+    memset(&r, 0, sizeof(r));
+    r.n = NUM_REGS + limit;
+    r.g.cap = 64;
+    r.g.edges = calloc(r.g.cap, sizeof(unsigned long long));
+    r.g.adj = calloc(r.n, sizeof(int*));
+    r.g.nadj = calloc(r.n, sizeof(int));
+    r.g.adj_cap = calloc(r.n, sizeof(int));
+    r.degree = calloc(r.n, sizeof(int));
+    r.state = calloc(r.n, sizeof(int));
+    r.alias = calloc(r.n, sizeof(int));
+    r.color = malloc(r.n * sizeof(int));
+    r.cost = calloc(r.n, sizeof(double));
+    r.move_list = calloc(r.n, sizeof(int*));
+    r.nmove_list = calloc(r.n, sizeof(int));
+    r.move_list_cap = calloc(r.n, sizeof(int));
+    r.select = malloc(r.n * sizeof(int));
+    r.mark = calloc(r.n, sizeof(int));
+
+    int nmoves = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            if (i->op == IR_MOVE) nmoves++;
+            int ids[2];
+            int nu;
+            vreg_uses(i, ids, &nu);
+            for (int s = 0; s < nu; s++) r.state[NUM_REGS + ids[s]] = NODE_INITIAL;
+            int d = vreg_def(i);
+            if (d >= 0) r.state[NUM_REGS + d] = NODE_INITIAL;
+        }
+    }
+    for (int n = 0; n < NUM_REGS; n++) {
+        r.state[n] = NODE_PRECOLORED;
+        r.color[n] = n;
+    }
+    r.moves = malloc((nmoves ? nmoves : 1) * sizeof(irc_move_t));
+    irc_build(&r, cfg, limit);
+
+    for (int n = NUM_REGS; n < r.n; n++) {
+        if (r.state[n] == NODE_INITIAL) irc_classify(&r, n);
+    }
+    for (;;) {
+        if (r.nworklist) {  // Simplify
+            int n = r.worklist[--r.nworklist];
+            if (r.state[n] != NODE_SIMPLIFY) continue;
+            r.state[n] = NODE_SELECT;
+            r.select[r.nselect++] = n;
+            for (int k = 0; k < r.g.nadj[n]; k++) {
+                int m = irc_adjacent(&r, n, k);
+                if (m >= 0) irc_decrement_degree(&r, m);
+            }
+        } else if (r.nmove_work) {
+            int m = r.move_work[--r.nmove_work];
+            if (r.moves[m].state == MOVE_WORKLIST) irc_coalesce(&r, m);
+        } else if (r.nfreeze) {
+            int n = r.freeze_list[--r.nfreeze];
+            if (r.state[n] != NODE_FREEZE) continue;
+            r.state[n] = NODE_SIMPLIFY;
+            irc_push(&r.worklist, &r.nworklist, &r.worklist_cap, n);
+            irc_freeze_moves(&r, n);
+        } else if (r.nspill) {
+            // Potential spill: cheapest per unit of degree, i.e. little used, outside loops, in many conflicts
+            int best = -1;
+            int live_entries = 0;
+            for (int k = 0; k < r.nspill; k++) {
+                int n = r.spill_list[k];
+                if (r.state[n] != NODE_SPILL) continue;
+                r.spill_list[live_entries++] = n;
+                if (best < 0 || r.cost[n] * r.degree[best] < r.cost[best] * r.degree[n]) best = n;
+            }
+            r.nspill = live_entries;
+            if (best < 0) continue;
+            r.state[best] = NODE_SIMPLIFY;
+            irc_push(&r.worklist, &r.nworklist, &r.worklist_cap, best);
+            irc_freeze_moves(&r, best);
+        } else {
+            break;
+        }
+    }
+
+    // Select: pop nodes and take the first register no colored neighbour holds ($t before $s)
+    while (r.nselect) {
+        int n = r.select[--r.nselect];
+        int used[NUM_REGS] = { 0 };
+        for (int k = 0; k < r.g.nadj[n]; k++) {
+            int w = irc_alias(&r, r.g.adj[n][k]);
+            if (r.state[w] == NODE_COLORED || r.state[w] == NODE_PRECOLORED) used[r.color[w]] = 1;
+        }
+        int c = 0;
+        while (c < NUM_REGS && used[c]) c++;
+        if (c == NUM_REGS) {
+            r.state[n] = NODE_SPILLED;
+        } else {
+            r.state[n] = NODE_COLORED;
+            r.color[n] = c;
+        }
+    }
+
+    ir_func_t* f = cfg->func;
+    for (int v = 0; v < limit; v++) {
+        int n = NUM_REGS + v;
+        if (r.state[n] == NODE_NONE) continue;
+        int a = irc_alias(&r, n);
+        if (r.state[a] == NODE_COLORED) {
+            ivs[v].reg = r.color[a];
+            if (is_callee_saved(ivs[v].reg)) f->saved_regs |= 1u << (ivs[v].reg - NUM_T_REGS);
+        } else if (a == n) {  // Actual spill: a slot shared by what coalesced into it
+            ivs[v].slot = irc_spill_slot(&r, n, ivs, f);
+            ra_spilled++;
+        }
+        ra_intervals++;
+    }
+    for (int v = 0; v < limit; v++) {
+        int a = irc_alias(&r, NUM_REGS + v);
+        if (a != NUM_REGS + v && r.state[a] == NODE_SPILLED) ivs[v].slot = ivs[a - NUM_REGS].slot;
+    }
+
+    for (int n = 0; n < r.n; n++) {
+        free(r.g.adj[n]);
+        free(r.move_list[n]);
+    }
+    free(r.g.adj);
+    free(r.g.nadj);
+    free(r.g.adj_cap);
+    free(r.g.edges);
+    free(r.degree);
+    free(r.state);
+    free(r.alias);
+    free(r.color);
+    free(r.cost);
+    free(r.move_list);
+    free(r.nmove_list);
+    free(r.move_list_cap);
+    free(r.moves);
+    free(r.move_work);
+    free(r.worklist);
+    free(r.freeze_list);
+    free(r.spill_list);
+    free(r.select);
+    free(r.mark);
+}
+
+
+void allocate_registers(ir_func_t* f, regalloc_kind_t kind) {
+    cfg_t* cfg = build_cfg(f);
+    int limit = cfg_vreg_limit(cfg);
+    if (limit > 0) {
+        int* calls;
+        int ncalls;
+        interval_t* ivs = build_intervals(cfg, limit, &calls, &ncalls);
+        if (kind == REGALLOC_GRAPH) {
+            graph_color(cfg, limit, ivs);
+        } else {
+            interval_t** sorted = malloc(limit * sizeof(interval_t*));
+            int n = 0;
+            for (int v = 0; v < limit; v++) {
+                if (ivs[v].end < 0) continue;
+                ivs[v].crosses_call = crosses_call(&ivs[v], calls, ncalls);
+                sorted[n++] = &ivs[v];
+            }
+            qsort(sorted, n, sizeof(interval_t*), by_start);
+            ra_intervals += n;
+            linear_scan(sorted, n, f);
+            free(sorted);
+        }
+        rewrite(cfg, ivs, limit);
+        free(calls);
+        free(ivs);
+    }
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            if (i->op != IR_LABEL) ra_code_size++;
+        }
+    }
+    linearize_cfg(cfg);
+    free_cfg(cfg);
+}
+
+
+void print_regalloc_stats(FILE* out) {
+    if (!ra_intervals) return;
+    fprintf(out, "Register allocation: %d values, %d spilled, %d spill loads/stores, %d instructions in function bodies\n",
+            ra_intervals, ra_spilled, ra_spill_instrs, ra_code_size);
+}
@@ -0,0 +1,27 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "cfg.h"
+
+
+// Coalesce `move a, b` between virtual registers whose live ranges do not interfere: both become one
+// register and the move disappears (run after SSA destruction). Returns the number of moves removed
+int coalesce_moves(cfg_t* cfg);
+
+
+typedef enum {
+    REGALLOC_LINEAR,  // Linear scan over live intervals: fast, the default below -O2
+    REGALLOC_GRAPH  // Iterated register coalescing (George and Appel) on the interference graph
+} regalloc_kind_t;
+
+
+// Map the function's virtual registers onto $t0-$t9 and $s0-$s7. Values live across a call get
+// callee-saved registers or are spilled to stack slots (f->spill_slots words from f->spill_base in the
+// frame, shared by spilled values that are never live together); the $s registers used are recorded
+// in f->saved_regs for the prologue to save
+void allocate_registers(ir_func_t* f, regalloc_kind_t kind);
+
+
+void print_regalloc_stats(FILE* out);
+
+#endif
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sccp.h"
+#include "ssa.h"
+
+
+typedef enum {
+    LAT_TOP,  // No definition seen yet
+    LAT_CONST,
+    LAT_BOTTOM  // Not a compile-time constant
+} lat_state_t;
+
+
+typedef struct {
+    lat_state_t state;
+    int val;
+} lat_t;
+
+
+typedef struct {
+    bb_t* block;
+    int succ;
+} flow_edge_t;
+
+
+typedef struct {
+    cfg_t* cfg;
+    ssa_info_t* info;
+    lat_t* lat;
+    char* visited;  // Block has been reached by an executable edge
+    char** edge_exec;  // edge_exec[b->id][k]: edge b -> b->succs[k] is executable
+    flow_edge_t* flow;
+    int nflow;
+    int flow_cap;
+    ssa_site_t* work;
+    int nwork;
+    int work_cap;
+} sccp_state_t;
+
+
+static lat_t value_of(sccp_state_t* st, const char* name) {
+    lat_t v = { LAT_BOTTOM, 0 };
+    if (!name) return v;
+    if (strcmp(name, "$zero") == 0) {
+        v.state = LAT_CONST;
+        return v;
+    }
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= st->info->limit) return v;  // Physical registers are opaque
+    return st->lat[id];
+}
+
+
+static void push_flow(sccp_state_t* st, bb_t* b, int succ) {
+    if (st->edge_exec[b->id][succ]) return;
+    if (st->nflow == st->flow_cap) {
+        st->flow_cap = st->flow_cap ? st->flow_cap * 2 : 64;
+        st->flow = realloc(st->flow, st->flow_cap * sizeof(flow_edge_t));
+    }
+    st->flow[st->nflow].block = b;
+    st->flow[st->nflow].succ = succ;
+    st->nflow++;
+}
+
+
+static void push_uses(sccp_state_t* st, int id) {
+    for (int u = st->info->use_start[id]; u < st->info->use_start[id + 1]; u++) {
+        if (st->nwork == st->work_cap) {
+            st->work_cap = st->work_cap ? st->work_cap * 2 : 64;
+            st->work = realloc(st->work, st->work_cap * sizeof(ssa_site_t));
+        }
+        st->work[st->nwork++] = st->info->uses[u];
+    }
+}
+
+
+static void lower_to(sccp_state_t* st, ir_instr_t* i, lat_t v) {
+    char** d = ir_def(i);
+    int id = d ? ir_vreg_id(*d) : -1;
+    if (id < 0) return;
+    lat_t old = st->lat[id];
+    lat_t meet = old;
+    if (old.state == LAT_BOTTOM || v.state == LAT_TOP) return;
+    if (old.state == LAT_TOP) meet = v;
+    else if (v.state == LAT_BOTTOM || v.val != old.val) meet.state = LAT_BOTTOM;
+    if (meet.state == old.state && meet.val == old.val) return;
+    st->lat[id] = meet;
+    push_uses(st, id);
+}
+
+
+static int fits_simm16(int v) {
+    return v >= -32768 && v <= 32767;
+}
+
+
+// Compute a def's value when all register sources are constants a and b
+static int fold(ir_instr_t* i, int a, int b) {
+    unsigned ua = (unsigned)a;
+    unsigned ub = (unsigned)b;
+    switch (i->op) {
+        case IR_ADD: case IR_ADDU: return (int)(ua + ub);
+        case IR_SUB: case IR_SUBU: return (int)(ua - ub);
+        case IR_AND: return a & b;
+        case IR_OR: return a | b;
+        case IR_XOR: return a ^ b;
+        case IR_NOR: return ~(a | b);
+        case IR_SLT: return a < b;
+        case IR_SLTU: return ua < ub;
+        case IR_ADDI: case IR_ADDIU: return (int)(ua + (unsigned)i->imm);
+        case IR_SLTI: return a < i->imm;
+        case IR_SLTIU: return ua < (unsigned)i->imm;
+        case IR_ANDI: return a & (i->imm & 0xFFFF);
+        case IR_ORI: return a | (i->imm & 0xFFFF);
+        case IR_XORI: return a ^ (i->imm & 0xFFFF);
+        case IR_LUI: return (int)((unsigned)i->imm << 16);
+        case IR_SRL: return (int)(ua >> (i->imm & 31));
+        case IR_LI: return i->imm;
+        case IR_MOVE: return a;
+        case IR_MUL: return (int)(ua * ub);
+        case IR_DIV: return (a == (-2147483647 - 1) && b == -1) ? a : a / b;  // Wraps like the hardware would
+        case IR_DIVU: return (int)(ua / ub);
+        default: return 0;
+    }
+}
+
+
+static int is_foldable(ir_op_t op) {
+    return (op >= IR_ADDI && op <= IR_SRL) || op == IR_LI || op == IR_MOVE || op == IR_MUL || op == IR_DIV || op == IR_DIVU;
+}
+
+
+static int edge_index(bb_t* from, bb_t* to) {
+    for (int k = 0; k < from->nsuccs; k++) {
+        if (from->succs[k] == to) return k;
+    }
+    return -1;
+}
+
+
+static void eval_branch(sccp_state_t* st, ir_instr_t* i, bb_t* b) {
+    lat_t a = value_of(st, i->src1);
+    lat_t c = (i->op == IR_BEQ || i->op == IR_BNE) ? value_of(st, i->src2) : (lat_t){ LAT_CONST, 0 };
+    if (a.state == LAT_TOP || c.state == LAT_TOP) return;
+    if (a.state == LAT_BOTTOM || c.state == LAT_BOTTOM) {
+        for (int k = 0; k < b->nsuccs; k++) push_flow(st, b, k);
+        return;
+    }
+    int taken = 0;
+    switch (i->op) {
+        case IR_BEQ: taken = a.val == c.val; break;
+        case IR_BNE: taken = a.val != c.val; break;
+        case IR_BLTZ: taken = a.val < 0; break;
+        case IR_BGEZ: taken = a.val >= 0; break;
+        case IR_BLEZ: taken = a.val <= 0; break;
+        case IR_BGTZ: taken = a.val > 0; break;
+        default: break;
+    }
+    if (taken) push_flow(st, b, 0);
+    else if (b->nsuccs > 1) push_flow(st, b, 1);
+}
+
+
+static void eval_instr(sccp_state_t* st, ir_instr_t* i, bb_t* b) {
+    if (ir_is_cond_branch(i->op)) {
+        eval_branch(st, i, b);
+        return;
+    }
+    if (i->op == IR_J) {
+        push_flow(st, b, 0);
+        return;
+    }
+
+    lat_t v = { LAT_BOTTOM, 0 };
+    if (i->op == IR_PHI) {
+        v.state = LAT_TOP;
+        for (int k = 0; k < i->nargs; k++) {
+            bb_t* p = b->preds[k];
+            int e = edge_index(p, b);
+            if (e < 0 || !st->edge_exec[p->id][e]) continue;
+            lat_t a = value_of(st, i->args[k]);
+            if (a.state == LAT_TOP) continue;
+            if (a.state == LAT_BOTTOM || (v.state == LAT_CONST && v.val != a.val)) {
+                v.state = LAT_BOTTOM;
+                break;
+            }
+            v = a;
+        }
+    } else if (is_foldable(i->op)) {
+        char** slots[2];
+        int n = ir_uses(i, slots);
+        lat_t ops[2] = { { LAT_CONST, 0 }, { LAT_CONST, 0 } };
+        for (int s = 0; s < n; s++) ops[s] = value_of(st, *slots[s]);
+        int zero_operand = (ops[0].state == LAT_CONST && ops[0].val == 0) || (ops[1].state == LAT_CONST && ops[1].val == 0);
+        int annihilated = ((i->op == IR_AND || i->op == IR_MUL) && zero_operand) || (i->op == IR_ANDI && (i->imm & 0xFFFF) == 0);
+        int div_by_zero = (i->op == IR_DIV || i->op == IR_DIVU) && ops[1].state == LAT_CONST && ops[1].val == 0;
+        if (annihilated) {
+            v.state = LAT_CONST;  // x & 0 and x * 0 are 0 whatever x is
+        } else if (div_by_zero) {
+            v.state = LAT_BOTTOM;  // Left to the div routine
+        } else if (ops[0].state == LAT_TOP || ops[1].state == LAT_TOP) {
+            v.state = LAT_TOP;
+        } else if (ops[0].state == LAT_CONST && ops[1].state == LAT_CONST) {
+            v.state = LAT_CONST;
+            v.val = fold(i, ops[0].val, ops[1].val);
+        }
+    }
+    lower_to(st, i, v);
+}
+
+
+static void visit_block(sccp_state_t* st, bb_t* b, int first_visit) {
+    for (ir_instr_t* i = b->first; i; i = i->next) {
+        if (i->op != IR_PHI && !first_visit) break;  // Later visits only re-evaluate phis
+        eval_instr(st, i, b);
+    }
+    if (!first_visit) return;
+    ir_instr_t* last = b->last;
+    if (b->nsuccs == 1 && !(last && (ir_is_cond_branch(last->op) || last->op == IR_J))) push_flow(st, b, 0);
+}
+
+
+static void remove_last(bb_t* b) {
+    ir_instr_t* prev = NULL;
+    for (ir_instr_t* p = b->first; p != b->last; p = p->next) prev = p;
+    if (prev) prev->next = NULL;
+    else b->first = NULL;
+    b->last = prev;
+}
+
+
+// Replace constant register operands: 0 becomes $zero, others become I-type immediates where the ISA has one
+static void rewrite_operands(sccp_state_t* st, ir_instr_t* i, char* zero) {
+    char** slots[2];
+    int n = ir_uses(i, slots);
+    for (int s = 0; s < n; s++) {
+        lat_t v = value_of(st, *slots[s]);
+        if (v.state == LAT_CONST && v.val == 0) *slots[s] = zero;
+    }
+
+    if (i->op == IR_MOVE) {
+        lat_t v = value_of(st, i->src1);
+        if (v.state == LAT_CONST && i->src1 != zero) {
+            i->op = IR_LI;
+            i->src1 = NULL;
+            i->imm = v.val;
+        }
+        return;
+    }
+
+    lat_t a = value_of(st, i->src1);
+    lat_t b = value_of(st, i->src2);
+    int a_const = i->src2 && a.state == LAT_CONST && i->src1 != zero;
+    int b_const = i->src2 && b.state == LAT_CONST && i->src2 != zero;
+    ir_op_t imm_op = i->op;
+    int imm = 0;
+    char* reg = NULL;
+
+    switch (i->op) {
+        case IR_ADD:
+        case IR_ADDU:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR: {
+            int logical = i->op == IR_AND || i->op == IR_OR || i->op == IR_XOR;
+            lat_t c = b_const ? b : a;
+            if (!(a_const || b_const)) break;
+            if (logical ? (c.val < 0 || c.val > 0xFFFF) : !fits_simm16(c.val)) break;
+            imm_op = i->op == IR_ADD ? IR_ADDI : i->op == IR_ADDU ? IR_ADDIU : i->op == IR_AND ? IR_ANDI : i->op == IR_OR ? IR_ORI : IR_XORI;
+            imm = c.val;
+            reg = b_const ? i->src1 : i->src2;  // Commutative: keep the non-constant side
+            break;
+        }
+        case IR_SUB:
+        case IR_SUBU:
+            if (!b_const || !fits_simm16(-b.val) || b.val == (-2147483647 - 1)) break;
+            imm_op = i->op == IR_SUB ? IR_ADDI : IR_ADDIU;
+            imm = -b.val;
+            reg = i->src1;
+            break;
+        case IR_SLT:
+        case IR_SLTU:
+            if (!b_const || !fits_simm16(b.val)) break;
+            imm_op = i->op == IR_SLT ? IR_SLTI : IR_SLTIU;
+            imm = b.val;
+            reg = i->src1;
+            break;
+        default:
+            break;
+    }
+    if (reg) {
+        i->op = imm_op;
+        i->src1 = reg;
+        i->src2 = NULL;
+        i->imm = imm;
+    }
+}
+
+
+void sccp(cfg_t* cfg) {
+    ir_func_t* f = cfg->func;
+    sccp_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    st.info = ssa_build_info(cfg);
+    st.lat = calloc(st.info->limit ? st.info->limit : 1, sizeof(lat_t));
+    st.visited = calloc(cfg->nblocks, 1);
+    st.edge_exec = malloc(cfg->nblocks * sizeof(char*));
+    for (int k = 0; k < cfg->nblocks; k++) st.edge_exec[k] = calloc(cfg->blocks[k]->nsuccs + 1, 1);
+
+    // Definitions that are not foldable (loads, call results, ...) are bottom from the start
+    st.visited[0] = 1;
+    visit_block(&st, cfg->blocks[0], 1);
+
+    while (st.nflow || st.nwork) {
+        if (st.nflow) {
+            flow_edge_t e = st.flow[--st.nflow];
+            if (st.edge_exec[e.block->id][e.succ]) continue;
+            st.edge_exec[e.block->id][e.succ] = 1;
+            bb_t* to = e.block->succs[e.succ];
+            int first = !st.visited[to->id];
+            st.visited[to->id] = 1;
+            visit_block(&st, to, first);
+        } else {
+            ssa_site_t site = st.work[--st.nwork];
+            if (st.visited[site.block->id]) eval_instr(&st, site.instr, site.block);
+        }
+    }
+
+    // Decided branches become jumps or fall-throughs
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        if (!st.visited[k] || b->nsuccs != 2 || !b->last || !ir_is_cond_branch(b->last->op)) continue;
+        int taken = st.edge_exec[k][0];
+        int fall = st.edge_exec[k][1];
+        if (taken == fall) continue;
+        if (taken) {
+            b->last->op = IR_J;
+            b->last->src1 = NULL;
+            b->last->src2 = NULL;
+            ssa_remove_edge(b, b->succs[1]);
+        } else {
+            remove_last(b);
+            ssa_remove_edge(b, b->succs[0]);
+        }
+    }
+
+    // Constant definitions become li, constant operands become immediates
+    char* zero = ir_intern(f, "$zero");
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        if (!st.visited[k]) continue;
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            char** d = ir_def(i);
+            lat_t v = d ? value_of(&st, *d) : (lat_t){ LAT_BOTTOM, 0 };
+            if (d && ir_vreg_id(*d) >= 0 && v.state == LAT_CONST) {
+                if (i->op == IR_PHI) {  // Keep the phis together at the top of the block
+                    if (prev) prev->next = next;
+                    else b->first = next;
+                    if (b->last == i) b->last = prev;
+                    cfg_insert_at_start(b, new_ir(f, IR_LI, *d, NULL, NULL, v.val));
+                    i = next;
+                    continue;
+                }
+                i->op = IR_LI;
+                i->src1 = NULL;
+                i->src2 = NULL;
+                i->imm = v.val;
+            } else if (i->op != IR_PHI) {
+                rewrite_operands(&st, i, zero);
+            }
+            prev = i;
+            i = next;
+        }
+    }
+
+    ssa_remove_unreachable(cfg);  // Blocks never visited are no longer reachable
+
+    for (int k = 0; k < cfg->nblocks; k++) free(st.edge_exec[k]);
+    free(st.edge_exec);
+    free(st.visited);
+    free(st.lat);
+    free(st.flow);
+    free(st.work);
+    ssa_free_info(st.info);
+}
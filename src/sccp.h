@@ -0,0 +1,12 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "cfg.h"
+
+
+// Sparse conditional constant propagation over SSA (Wegman and Zadeck): folds constants through
+// arithmetic, comparisons and phis, turns decided branches into jumps, drops unreachable blocks
+// and rewrites constant operands into I-type immediates or $zero
+void sccp(cfg_t* cfg);
+
+#endif
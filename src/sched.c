@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sched.h"
+
+
+// Longest stretch scheduled at once (the dependence matrix is quadratic in it)
+#define MAX_REGION 256
+
+
+// Counters for --stats
+static int sched_ran = 0;
+static int stalls_before = 0;
+static int stalls_after = 0;
+static int delay_slots = 0;
+static int filled_before = 0;
+static int filled_target = 0;
+
+
+// Machine description: cycles from issue until the result can be read without a stall
+static int latency(ir_op_t op) {
+    return op == IR_LW ? 2 : 1;  // Loads go through the memory stage first; everything else forwards
+}
+
+
+static int has_delay_slot(ir_op_t op) {
+    return ir_is_cond_branch(op) || op == IR_J || op == IR_JAL || op == IR_JR || op == IR_JALR;
+}
+
+
+// Nothing moves across these: block boundaries, control transfers and system instructions
+static int ends_region(ir_op_t op) {
+    return has_delay_slot(op) || op == IR_LABEL || op == IR_SYSC || op == IR_ERET || op == IR_MOVG2S || op == IR_MOVS2G;
+}
+
+
+static int is_mem(ir_op_t op) {
+    return op == IR_LW || op == IR_SW;
+}
+
+
+static int same_reg(const char* a, const char* b) {
+    return a && b && strcmp(a, b) == 0;
+}
+
+
+static int writes(ir_instr_t* i, const char* reg) {
+    char** d = ir_def(i);
+    return d && same_reg(*d, reg);
+}
+
+
+static int reads(ir_instr_t* i, const char* reg) {
+    char** slots[2];
+    int n = ir_uses(i, slots);
+    for (int s = 0; s < n; s++) {
+        if (same_reg(*slots[s], reg)) return 1;
+    }
+    return 0;
+}
+
+
+// Does b read a register a writes?
+static int reads_def_of(ir_instr_t* b, ir_instr_t* a) {
+    char** d = ir_def(a);
+    return d && reads(b, *d);
+}
+
+
+// Does a load or store read what the one before it wrote? Accesses through the same base register are told
+// apart by offset, others by alias class (next_base_write: position of the next write of a's base register
+// after a)
+static int mem_conflict(ir_instr_t* a, ir_instr_t* b, int next_base_write, int b_pos) {
+    if ((a->op != IR_SW && b->op != IR_SW) || !ir_may_alias(a->mem, b->mem)) return 0;
+    int disjoint = same_reg(a->src1, b->src1) && next_base_write > b_pos && (a->imm + 4 <= b->imm || b->imm + 4 <= a->imm);
+    return !disjoint;
+}
+
+
+static int load_use_stalls(ir_instr_t** seq, int n) {
+    int stalls = 0;
+    for (int k = 0; k + 1 < n; k++) {
+        if (seq[k]->op == IR_LW && reads_def_of(seq[k + 1], seq[k])) stalls++;
+    }
+    return stalls;
+}
+
+
+// List scheduling of one region (straight-line code, no control transfers): lat[i * n + j] >= 0 when j
+// must follow i and can issue lat cycles after it at the earliest. Each step issues the ready instruction
+// with the longest path to the end of the region, stalling only when nothing is ready. Returns the
+// dependence matrix for delay slot filling; order receives the positions in issue order
+static int* schedule_region(ir_instr_t** seq, int n, int* order) {
+    int* lat = malloc((size_t)n * n * sizeof(int));
+    for (int k = 0; k < n * n; k++) lat[k] = -1;
+    for (int i = 0; i < n; i++) {
+        int next_base_write = n;
+        if (is_mem(seq[i]->op)) {
+            for (int k = i + 1; k < n && next_base_write == n; k++) {
+                if (writes(seq[k], seq[i]->src1)) next_base_write = k;
+            }
+        }
+        char** di = ir_def(seq[i]);
+        for (int j = i + 1; j < n; j++) {
+            int l = -1;
+            if (reads_def_of(seq[j], seq[i])) l = latency(seq[i]->op);  // True dependence
+            char** dj = ir_def(seq[j]);
+            if (dj && (reads(seq[i], *dj) || (di && same_reg(*di, *dj))) && l < 1) l = 1;  // Anti and output
+            if (is_mem(seq[i]->op) && is_mem(seq[j]->op) && mem_conflict(seq[i], seq[j], next_base_write, j) && l < 1) l = 1;
+            lat[i * n + j] = l;
+        }
+    }
+
+    int* height = malloc(n * sizeof(int));
+    int* earliest = calloc(n, sizeof(int));
+    int* waiting = calloc(n, sizeof(int));  // Unscheduled predecessors
+    char* done = calloc(n, 1);
+    for (int i = n - 1; i >= 0; i--) {
+        height[i] = latency(seq[i]->op);
+        for (int j = i + 1; j < n; j++) {
+            if (lat[i * n + j] < 0) continue;
+            waiting[j]++;
+            if (lat[i * n + j] + height[j] > height[i]) height[i] = lat[i * n + j] + height[j];
+        }
+    }
+
+    int cycle = 0;
+    for (int step = 0; step < n; step++) {
+        int best = -1;
+        for (int k = 0; k < n; k++) {
+            if (done[k] || waiting[k]) continue;
+            int ready_now = earliest[k] <= cycle;
+            if (best < 0) {
+                best = k;
+                continue;
+            }
+            int best_ready = earliest[best] <= cycle;
+            if (ready_now != best_ready) {
+                if (ready_now) best = k;
+            } else if (ready_now ? height[k] > height[best] : earliest[k] < earliest[best]) {
+                best = k;
+            }
+        }
+        if (earliest[best] > cycle) cycle = earliest[best];  // Stall: nothing was ready
+        done[best] = 1;
+        order[step] = best;
+        for (int j = 0; j < n; j++) {
+            if (lat[best * n + j] < 0) continue;
+            waiting[j]--;
+            if (cycle + lat[best * n + j] > earliest[j]) earliest[j] = cycle + lat[best * n + j];
+        }
+        cycle++;
+    }
+    free(height);
+    free(earliest);
+    free(waiting);
+    free(done);
+    return lat;
+}
+
+
+// Could x run in the delay slot of branch t instead of before it? It must leave t's operands and $ra
+// alone (jal and jalr write $ra before the slot runs), and be a single machine instruction
+static int fits_delay_slot(ir_instr_t* x, ir_instr_t* t) {
+    if (x->op == IR_LI && (x->imm < -32768 || x->imm > 32767)) return 0;  // lui + ori
+    return !reads_def_of(t, x) && !writes(x, "$ra") && !reads(x, "$ra");
+}
+
+
+static unsigned hash_name(const char* s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+
+// Unconditional jumps whose slot is still a nop take a copy of the first instruction at the target and
+// jump past it instead
+static void fill_from_target(ir_func_t* f) {
+    int nlabels = 0;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op == IR_LABEL) nlabels++;
+    }
+    int cap = 16;
+    while (cap < nlabels * 2) cap *= 2;
+    ir_instr_t** map = calloc(cap, sizeof(ir_instr_t*));
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op != IR_LABEL) continue;
+        unsigned h = hash_name(i->dest) & (cap - 1);
+        while (map[h]) h = (h + 1) & (cap - 1);
+        map[h] = i;
+    }
+
+    for (ir_instr_t* j = f->body; j; j = j->next) {
+        if (j->op != IR_J || !j->next || j->next->op != IR_NOP) continue;
+        ir_instr_t* label = NULL;
+        for (unsigned h = hash_name(j->dest) & (cap - 1); map[h]; h = (h + 1) & (cap - 1)) {
+            if (same_reg(map[h]->dest, j->dest)) label = map[h];
+        }
+        ir_instr_t* t = label ? label->next : NULL;
+        // The prologue follows the save point and the frame teardown follows the restore point
+        if (!t || label == f->save_point || label == f->restore_point || t == f->restore_point || t->op == IR_NOP || ends_region(t->op) || !fits_delay_slot(t, j)) continue;
+        ir_instr_t* slot = j->next;
+        slot->op = t->op;
+        slot->dest = t->dest;
+        slot->src1 = t->src1;
+        slot->src2 = t->src2;
+        slot->imm = t->imm;
+        slot->mem = t->mem;
+        if (!t->next || t->next->op != IR_LABEL) {
+            ir_instr_t* past = new_ir(f, IR_LABEL, new_label(f), NULL, NULL, 0);
+            past->next = t->next;
+            t->next = past;
+        }
+        j->dest = t->next->dest;
+        filled_target++;
+    }
+    free(map);
+}
+
+
+void schedule_func(ir_func_t* f, int optimize) {
+    sched_ran = 1;
+    int n = 0;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op != IR_NOP) n++;
+    }
+    ir_instr_t** instrs = malloc((n ? n : 1) * sizeof(ir_instr_t*));
+    n = 0;
+    for (ir_instr_t* i = f->body; i; i = i->next) {
+        if (i->op != IR_NOP) instrs[n++] = i;
+    }
+
+    ir_instr_t* head = NULL;
+    ir_instr_t* tail = NULL;
+    int* order = malloc(MAX_REGION * sizeof(int));
+    ir_instr_t** seq = malloc(MAX_REGION * sizeof(ir_instr_t*));
+    int k = 0;
+    while (k < n) {
+        // A region runs up to the next label or control transfer, or through the restore point
+        int start = k;
+        int pinned = 0;
+        while (k < n && k - start < MAX_REGION && !ends_region(instrs[k]->op)) {
+            if (instrs[k++] == f->restore_point) {
+                pinned = 1;  // The frame teardown comes right after it: keep the order
+                break;
+            }
+        }
+        int len = k - start;
+        ir_instr_t* term = (!pinned && k < n && has_delay_slot(instrs[k]->op)) ? instrs[k] : NULL;
+
+        for (int r = 0; r < len; r++) seq[r] = instrs[start + r];
+        stalls_before += load_use_stalls(seq, len);
+        int* lat = NULL;
+        if (optimize && !pinned && len > 1) {
+            lat = schedule_region(instrs + start, len, order);
+            for (int r = 0; r < len; r++) seq[r] = instrs[start + order[r]];
+        }
+
+        ir_instr_t* slot = NULL;
+        if (term && optimize && len > 0) {  // Latest-issued instruction nothing after it depends on
+            for (int r = len - 1; r >= 0 && !slot; r--) {
+                int p = lat ? order[r] : r;
+                int free_after = 1;
+                for (int q = p + 1; q < len && free_after; q++) {
+                    int dep = lat ? lat[p * len + q] >= 0 : 1;
+                    if (dep) free_after = 0;
+                }
+                if (free_after && fits_delay_slot(instrs[start + p], term)) {
+                    slot = instrs[start + p];
+                    for (int q = r; q + 1 < len; q++) seq[q] = seq[q + 1];
+                    len--;
+                }
+            }
+        }
+        free(lat);
+        stalls_after += load_use_stalls(seq, len);
+
+        for (int r = 0; r < len; r++) append_ir(&head, &tail, seq[r]);
+        if (k < n && !pinned && !term && ends_region(instrs[k]->op)) {  // Labels and system instructions
+            append_ir(&head, &tail, instrs[k++]);
+        } else if (term) {
+            append_ir(&head, &tail, term);
+            k++;
+            delay_slots++;
+            if (slot) filled_before++;
+            ir_instr_t* filled = slot ? slot : new_ir(f, IR_NOP, NULL, NULL, NULL, 0);
+            append_ir(&head, &tail, filled);
+            if (term == f->restore_point) f->restore_point = filled;  // A call's slot still runs with the frame
+        }
+    }
+    if (tail) tail->next = NULL;
+    f->body = head;
+    free(instrs);
+    free(order);
+    free(seq);
+
+    if (optimize) fill_from_target(f);
+}
+
+
+void print_sched_stats(FILE* out) {
+    if (!sched_ran) return;
+    fprintf(out, "Scheduling: %d load-use stalls left of %d, %d delay slots (%d filled from before the branch, %d from the target, %d nops)\n",
+            stalls_after, stalls_before, delay_slots, filled_before, filled_target, delay_slots - filled_before - filled_target);
+}
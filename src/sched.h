@@ -0,0 +1,22 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdio.h>
+#include "IR.h"
+
+
+// Pipeline of the Paul MIPS (System Architecture): branches and jumps are delayed by one instruction,
+// which runs whether or not the branch is taken; a load's result reaches the next instruction only
+// after a one-cycle stall. Runs on the final code, after frame layout and register allocation.
+//
+// With optimize set, every block is list scheduled to hide load latency (longest path to the end of
+// the block first), and each delay slot takes an independent instruction from before its branch or,
+// for a jump, a copy of the first instruction at the target. Otherwise, and whenever nothing fits,
+// the slot gets a nop. Afterwards every branch, jump and call is followed by its delay slot
+void schedule_func(ir_func_t* f, int optimize);
+
+
+// Scheduling counters for --stats
+void print_sched_stats(FILE* out);
+
+#endif
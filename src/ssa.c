@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ssa.h"
+
+
+static int is_promotable_type(ir_var_t* v) {
+    if (!v->type || v->size != 4) return 0;
+    switch (v->type->kind) {
+        case TYPE_INT:
+        case TYPE_BOOL:
+        case TYPE_CHAR:
+        case TYPE_UINT:
+        case TYPE_POINTER: return 1;
+        default: return 0;  // Structs and arrays stay in memory
+    }
+}
+
+
+static void remove_instr(bb_t* b, ir_instr_t* prev, ir_instr_t* i) {
+    if (prev) prev->next = i->next;
+    else b->first = i->next;
+    if (b->last == i) b->last = prev;
+}
+
+
+// Rewrite `la t, x` + `lw d, 0(t)` / `sw v, 0(t)` into moves of a virtual register standing for x
+static void promote_vars(cfg_t* cfg) {
+    ir_func_t* f = cfg->func;
+    int nvars = 0;
+    for (ir_var_t* v = f->vars; v; v = v->next) nvars++;
+    if (nvars == 0) return;
+
+    ir_var_t** vars = malloc(nvars * sizeof(ir_var_t*));
+    nvars = 0;
+    for (ir_var_t* v = f->vars; v; v = v->next) vars[nvars++] = v;
+
+    int limit = cfg_vreg_limit(cfg);
+    int* la_var = malloc((limit ? limit : 1) * sizeof(int));  // vreg defined by `la vreg, var` -> var index
+    for (int k = 0; k < limit; k++) la_var[k] = -1;
+    char* taken = calloc(nvars, 1);  // Address escapes (or var is not a scalar)
+
+    for (int k = 0; k < nvars; k++) taken[k] = !is_promotable_type(vars[k]);
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            if (i->op != IR_LA) continue;
+            for (int v = 0; v < nvars; v++) {
+                if (vars[v]->name == i->src1) {
+                    int id = ir_vreg_id(i->dest);
+                    if (id < 0 || la_var[id] >= 0) taken[v] = 1;  // Address reused oddly: leave it alone
+                    else la_var[id] = v;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < cfg->nblocks; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id < 0 || la_var[id] < 0) continue;
+                int as_base = (i->op == IR_LW || i->op == IR_SW) && slots[s] == &i->src1 && i->imm == 0;
+                if (!as_base || (i->op == IR_SW && i->dest == i->src1)) taken[la_var[id]] = 1;
+            }
+            for (int a = 0; a < i->nargs; a++) {
+                int id = ir_vreg_id(i->args[a]);
+                if (id >= 0 && la_var[id] >= 0) taken[la_var[id]] = 1;
+            }
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (i->op != IR_LA && id >= 0 && la_var[id] >= 0) taken[la_var[id]] = 1;
+        }
+    }
+
+    char** home = calloc(nvars, sizeof(char*));
+    int promoted = 0;
+    for (int v = 0; v < nvars; v++) {
+        if (!taken[v]) {
+            home[v] = new_temp(f);
+            promoted++;
+        }
+    }
+
+    if (promoted) {
+        for (int k = 0; k < cfg->nblocks; k++) {
+            bb_t* b = cfg->blocks[k];
+            ir_instr_t* prev = NULL;
+            for (ir_instr_t* i = b->first; i; ) {
+                ir_instr_t* next = i->next;
+                int id = -1;
+                if (i->op == IR_LA) id = ir_vreg_id(i->dest);
+                else if (i->op == IR_LW || i->op == IR_SW) id = ir_vreg_id(i->src1);
+                int v = (id >= 0) ? la_var[id] : -1;
+
+                if (v >= 0 && !taken[v]) {
+                    if (i->op == IR_LA) {
+                        remove_instr(b, prev, i);
+                        i = next;
+                        continue;
+                    }
+                    if (i->op == IR_LW) {  // lw d, 0(&x)  ->  move d, x
+                        i->op = IR_MOVE;
+                        i->src1 = home[v];
+                    } else {  // sw val, 0(&x)  ->  move x, val
+                        i->op = IR_MOVE;
+                        i->src1 = i->dest;
+                        i->dest = home[v];
+                    }
+                }
+                prev = i;
+                i = next;
+            }
+        }
+
+        // Promoted params start out with the value the caller passed: copied from $a0-$a3, loaded from
+        // the caller's outgoing-argument area past those
+        bb_t* entry = cfg->blocks[0];
+        for (int v = nvars - 1; v >= 0; v--) {
+            if (taken[v] || !vars[v]->is_param) continue;
+            if (vars[v]->param_index < NUM_ARG_REGS) {
+                char reg[4] = {'$', 'a', (char)('0' + vars[v]->param_index), '\0'};
+                cfg_insert_at_start(entry, new_ir(f, IR_MOVE, home[v], reg, NULL, 0));
+                continue;
+            }
+            char* addr = new_temp(f);
+            cfg_insert_at_start(entry, new_ir(f, IR_LW, home[v], addr, NULL, 0));
+            cfg_insert_at_start(entry, new_ir(f, IR_LA, addr, vars[v]->name, NULL, 0));
+        }
+    }
+
+    free(vars);
+    free(la_var);
+    free(taken);
+    free(home);
+}
+
+
+typedef struct {
+    bb_t** items;
+    int n;
+    int cap;
+} block_list_t;
+
+
+static void list_push(block_list_t* l, bb_t* b) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 4;
+        l->items = realloc(l->items, l->cap * sizeof(bb_t*));
+    }
+    l->items[l->n++] = b;
+}
+
+
+// Dominance frontiers, indexed by block id (Cooper, Harvey and Kennedy)
+static block_list_t* dominance_frontiers(cfg_t* cfg) {
+    block_list_t* df = calloc(cfg->nblocks, sizeof(block_list_t));
+    for (int k = 0; k < cfg->nrpo; k++) {
+        bb_t* b = cfg->rpo[k];
+        if (b->npreds < 2) continue;
+        for (int p = 0; p < b->npreds; p++) {
+            bb_t* runner = b->preds[p];
+            while (runner && runner != b->idom) {
+                block_list_t* l = &df[runner->id];
+                if (l->n == 0 || l->items[l->n - 1] != b) list_push(l, b);
+                runner = runner->idom;
+            }
+        }
+    }
+    return df;
+}
+
+
+typedef struct {
+    ir_func_t* f;
+    char** names;  // Original name of each vreg id
+    char*** stack;  // Current SSA name of each original vreg
+    int* sp;
+    int* cap;
+    char* renamed;  // First definition keeps the original name
+    int* log;  // Ids pushed, so a block can pop its own definitions
+    int nlog;
+    int log_cap;
+    char* zero;
+} rename_state_t;
+
+
+static char* top_name(rename_state_t* st, int id) {
+    return st->sp[id] ? st->stack[id][st->sp[id] - 1] : st->zero;  // Undefined on this path: any value will do
+}
+
+
+static void push_name(rename_state_t* st, int id, char* name) {
+    if (st->sp[id] == st->cap[id]) {
+        st->cap[id] = st->cap[id] ? st->cap[id] * 2 : 4;
+        st->stack[id] = realloc(st->stack[id], st->cap[id] * sizeof(char*));
+    }
+    st->stack[id][st->sp[id]++] = name;
+    if (st->nlog == st->log_cap) {
+        st->log_cap = st->log_cap ? st->log_cap * 2 : 64;
+        st->log = realloc(st->log, st->log_cap * sizeof(int));
+    }
+    st->log[st->nlog++] = id;
+}
+
+
+static char* fresh_name(rename_state_t* st, int id) {
+    if (!st->renamed[id]) {
+        st->renamed[id] = 1;
+        return st->names[id];
+    }
+    return new_temp(st->f);
+}
+
+
+static void rename_block(rename_state_t* st, bb_t* b) {
+    int saved = st->nlog;
+
+    for (ir_instr_t* i = b->first; i; i = i->next) {
+        if (i->op == IR_PHI) {
+            char* name = fresh_name(st, i->imm);
+            i->dest = name;
+            push_name(st, i->imm, name);
+            continue;
+        }
+        char** slots[2];
+        int n = ir_uses(i, slots);
+        for (int s = 0; s < n; s++) {
+            int id = ir_vreg_id(*slots[s]);
+            if (id >= 0) *slots[s] = top_name(st, id);
+        }
+        char** d = ir_def(i);
+        int id = d ? ir_vreg_id(*d) : -1;
+        if (id >= 0) {
+            char* name = fresh_name(st, id);
+            *d = name;
+            push_name(st, id, name);
+        }
+    }
+
+    for (int s = 0; s < b->nsuccs; s++) {
+        bb_t* succ = b->succs[s];
+        int j = cfg_pred_index(succ, b);
+        for (ir_instr_t* i = succ->first; i; i = i->next) {
+            if (i->op == IR_LABEL) continue;
+            if (i->op != IR_PHI) break;
+            i->args[j] = top_name(st, i->imm);
+        }
+    }
+
+    for (bb_t* c = b->dom_child; c; c = c->dom_sibling) rename_block(st, c);
+
+    while (st->nlog > saved) st->sp[st->log[--st->nlog]]--;
+}
+
+
+// Phis for the virtual registers defined in more than one place, then a fresh name for every definition
+static void rename_vregs(cfg_t* cfg) {
+    ir_func_t* f = cfg->func;
+    int limit = cfg_vreg_limit(cfg);
+    if (limit == 0) return;
+    int nb = cfg->nblocks;
+
+    char** names = calloc(limit, sizeof(char*));
+    char* global = calloc(limit, 1);  // Used in some block before being defined there
+    int* ndefs = calloc(limit, sizeof(int));
+    int* killed = calloc(limit, sizeof(int));
+
+    for (int k = 0; k < nb; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                int id = ir_vreg_id(*slots[s]);
+                if (id < 0) continue;
+                names[id] = *slots[s];
+                if (killed[id] != k + 1) global[id] = 1;
+            }
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (id < 0) continue;
+            names[id] = *d;
+            killed[id] = k + 1;
+            ndefs[id]++;
+        }
+    }
+
+    // Defining blocks of every vreg, packed (may repeat a block)
+    int* def_start = malloc((limit + 1) * sizeof(int));
+    def_start[0] = 0;
+    for (int id = 0; id < limit; id++) def_start[id + 1] = def_start[id] + ndefs[id];
+    bb_t** def_blocks = malloc((def_start[limit] ? def_start[limit] : 1) * sizeof(bb_t*));
+    memset(ndefs, 0, limit * sizeof(int));
+    for (int k = 0; k < nb; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** d = ir_def(i);
+            int id = d ? ir_vreg_id(*d) : -1;
+            if (id >= 0) def_blocks[def_start[id] + ndefs[id]++] = cfg->blocks[k];
+        }
+    }
+
+    // Phis on the iterated dominance frontier of each non-local name
+    block_list_t* df = dominance_frontiers(cfg);
+    int* has_phi = calloc(nb, sizeof(int));
+    int* in_work = calloc(nb, sizeof(int));
+    bb_t** work = malloc(nb * sizeof(bb_t*));
+    for (int id = 0; id < limit; id++) {
+        if (!global[id] || ndefs[id] == 0) continue;
+        int wn = 0;
+        for (int d = def_start[id]; d < def_start[id + 1]; d++) {
+            bb_t* b = def_blocks[d];
+            if (in_work[b->id] != id + 1) {
+                in_work[b->id] = id + 1;
+                work[wn++] = b;
+            }
+        }
+        while (wn) {
+            bb_t* b = work[--wn];
+            for (int k = 0; k < df[b->id].n; k++) {
+                bb_t* y = df[b->id].items[k];
+                if (has_phi[y->id] == id + 1) continue;
+                has_phi[y->id] = id + 1;
+                ir_instr_t* phi = new_ir(f, IR_PHI, names[id], NULL, NULL, id);  // imm: original vreg id while renaming
+                phi->nargs = y->npreds;
+                phi->args = arena_alloc(f->arena, y->npreds * sizeof(char*));
+                cfg_insert_at_start(y, phi);
+                if (in_work[y->id] != id + 1) {
+                    in_work[y->id] = id + 1;
+                    work[wn++] = y;
+                }
+            }
+        }
+    }
+
+    rename_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.f = f;
+    st.names = names;
+    st.stack = calloc(limit, sizeof(char**));
+    st.sp = calloc(limit, sizeof(int));
+    st.cap = calloc(limit, sizeof(int));
+    st.renamed = calloc(limit, 1);
+    st.zero = ir_intern(f, "$zero");
+    rename_block(&st, cfg->rpo[0]);
+
+    for (int k = 0; k < nb; k++) {
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            if (i->op == IR_PHI) i->imm = 0;
+        }
+    }
+
+    for (int id = 0; id < limit; id++) free(st.stack[id]);
+    free(st.stack);
+    free(st.sp);
+    free(st.cap);
+    free(st.renamed);
+    free(st.log);
+    for (int k = 0; k < nb; k++) free(df[k].items);
+    free(df);
+    free(has_phi);
+    free(in_work);
+    free(work);
+    free(def_start);
+    free(def_blocks);
+    free(names);
+    free(global);
+    free(ndefs);
+    free(killed);
+}
+
+
+void ssa_construct(cfg_t* cfg) {
+    cfg_remove_unreachable(cfg);
+    promote_vars(cfg);
+    rename_vregs(cfg);
+}
+
+
+void ssa_reconstruct(cfg_t* cfg) {
+    cfg_remove_unreachable(cfg);
+    rename_vregs(cfg);
+}
+
+
+void ssa_remove_edge(bb_t* from, bb_t* to) {
+    int j = cfg_pred_index(to, from);
+    if (j < 0) return;
+    for (ir_instr_t* i = to->first; i; i = i->next) {
+        if (i->op == IR_LABEL) continue;
+        if (i->op != IR_PHI) break;
+        memmove(&i->args[j], &i->args[j + 1], (i->nargs - j - 1) * sizeof(char*));
+        i->nargs--;
+    }
+    cfg_remove_edge(from, to);
+}
+
+
+void ssa_remove_unreachable(cfg_t* cfg) {
+    cfg_analyze(cfg);
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        if (b->rpo >= 0) continue;
+        while (b->nsuccs) ssa_remove_edge(b, b->succs[0]);
+    }
+    cfg_remove_unreachable(cfg);
+}
+
+
+// Emit dest[k] <- src[k] for all k "at once" as a sequence of moves at the end of b
+static void sequentialize_copies(ir_func_t* f, bb_t* b, char** dest, char** src, int n) {
+    int pending = 0;
+    for (int k = 0; k < n; k++) {
+        if (dest[k] != src[k]) {
+            dest[pending] = dest[k];
+            src[pending] = src[k];
+            pending++;
+        }
+    }
+
+    while (pending) {
+        int ready = -1;
+        for (int k = 0; k < pending && ready < 0; k++) {
+            int blocked = 0;
+            for (int m = 0; m < pending; m++) {
+                if (m != k && src[m] == dest[k]) {
+                    blocked = 1;
+                    break;
+                }
+            }
+            if (!blocked) ready = k;
+        }
+
+        if (ready < 0) {
+            // Only cycles left: save one destination and redirect its readers to the copy
+            char* saved = new_temp(f);
+            cfg_insert_at_end(b, new_ir(f, IR_MOVE, saved, dest[0], NULL, 0));
+            for (int m = 0; m < pending; m++) {
+                if (src[m] == dest[0]) src[m] = saved;
+            }
+            continue;
+        }
+
+        cfg_insert_at_end(b, new_ir(f, IR_MOVE, dest[ready], src[ready], NULL, 0));
+        pending--;
+        dest[ready] = dest[pending];
+        src[ready] = src[pending];
+    }
+}
+
+
+void ssa_destruct(cfg_t* cfg) {
+    ir_func_t* f = cfg->func;
+    int nb = cfg->nblocks;
+    bb_t** blocks = malloc(nb * sizeof(bb_t*));
+    memcpy(blocks, cfg->blocks, nb * sizeof(bb_t*));  // Splitting edges reorders cfg->blocks
+
+    for (int k = 0; k < nb; k++) {
+        bb_t* b = blocks[k];
+        int nphis = 0;
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (i->op == IR_PHI) nphis++;
+            else if (i->op != IR_LABEL) break;
+        }
+        if (nphis == 0) continue;
+
+        char** dest = malloc(nphis * sizeof(char*));
+        char** src = malloc(nphis * sizeof(char*));
+        for (int j = 0; j < b->npreds; j++) {
+            bb_t* p = b->preds[j];
+            if (p->nsuccs > 1) p = cfg_split_edge(cfg, p, b);  // Critical edge: copies need a block of their own
+            int n = 0;
+            for (ir_instr_t* i = b->first; i; i = i->next) {
+                if (i->op != IR_PHI) continue;
+                dest[n] = i->dest;
+                src[n] = i->args[j];
+                n++;
+            }
+            sequentialize_copies(f, p, dest, src, n);
+        }
+        free(dest);
+        free(src);
+
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            if (i->op == IR_PHI) remove_instr(b, prev, i);
+            else prev = i;
+            i = next;
+        }
+    }
+    free(blocks);
+    cfg_analyze(cfg);
+}
+
+
+ssa_info_t* ssa_build_info(cfg_t* cfg) {
+    ssa_info_t* info = calloc(1, sizeof(ssa_info_t));
+    int limit = cfg_vreg_limit(cfg);
+    info->limit = limit;
+    info->defs = calloc(limit ? limit : 1, sizeof(ssa_site_t));
+    info->use_start = calloc(limit + 1, sizeof(int));
+
+    for (int pass = 0; pass < 2; pass++) {
+        int* fill = pass ? calloc(limit ? limit : 1, sizeof(int)) : NULL;
+        for (int k = 0; k < cfg->nblocks; k++) {
+            bb_t* b = cfg->blocks[k];
+            for (ir_instr_t* i = b->first; i; i = i->next) {
+                char** slots[2];
+                int n = ir_uses(i, slots);
+                for (int u = 0; u < n + i->nargs; u++) {
+                    int id = ir_vreg_id(u < n ? *slots[u] : i->args[u - n]);
+                    if (id < 0) continue;
+                    if (!pass) {
+                        info->use_start[id + 1]++;
+                    } else {
+                        ssa_site_t* site = &info->uses[info->use_start[id] + fill[id]++];
+                        site->instr = i;
+                        site->block = b;
+                    }
+                }
+                if (pass) continue;
+                char** d = ir_def(i);
+                int id = d ? ir_vreg_id(*d) : -1;
+                if (id >= 0) {
+                    info->defs[id].instr = i;
+                    info->defs[id].block = b;
+                }
+            }
+        }
+        if (!pass) {
+            for (int id = 0; id < limit; id++) info->use_start[id + 1] += info->use_start[id];
+            info->uses = malloc((info->use_start[limit] ? info->use_start[limit] : 1) * sizeof(ssa_site_t));
+        }
+        free(fill);
+    }
+    return info;
+}
+
+
+void ssa_free_info(ssa_info_t* info) {
+    free(info->defs);
+    free(info->use_start);
+    free(info->uses);
+    free(info);
+}
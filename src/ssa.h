@@ -0,0 +1,44 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "cfg.h"
+
+
+// Promote scalar locals/params that never have their address taken to virtual registers,
+// then rename every virtual register into SSA form with phis on the dominance frontiers
+void ssa_construct(cfg_t* cfg);
+
+
+// Back into SSA form after ssa_destruct, once a pass has restructured the code (nothing left to promote)
+void ssa_reconstruct(cfg_t* cfg);
+
+
+// Replace phis by sequentialized parallel copies on the incoming edges (splitting critical edges)
+void ssa_destruct(cfg_t* cfg);
+
+
+// Def-use chains of a function in SSA form, indexed by vreg id (a snapshot: rebuild after rewriting)
+typedef struct {
+    ir_instr_t* instr;
+    bb_t* block;
+} ssa_site_t;
+
+typedef struct {
+    int limit;  // One past the highest vreg id
+    ssa_site_t* defs;  // The single definition of each vreg (instr NULL if none)
+    int* use_start;  // Uses of vreg id are uses[use_start[id] .. use_start[id + 1])
+    ssa_site_t* uses;  // An instruction using a vreg twice appears twice
+} ssa_info_t;
+
+ssa_info_t* ssa_build_info(cfg_t* cfg);
+void ssa_free_info(ssa_info_t* info);
+
+
+// Remove the edge from -> to together with the matching phi operands in `to`
+void ssa_remove_edge(bb_t* from, bb_t* to);
+
+
+// Reanalyze and drop blocks no longer reachable from the entry, fixing up phis in the blocks they jumped to
+void ssa_remove_unreachable(cfg_t* cfg);
+
+#endif
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strength.h"
+#include "ssa.h"
+
+
+#define MAX_MUL_CHAIN 16  // Longest add chain still cheaper than a call to the software multiply
+
+
+typedef struct {
+    ir_func_t* f;
+    ir_instr_t* first;
+    ir_instr_t* tail;
+} seq_t;
+
+
+static char* emit(seq_t* s, ir_op_t op, char* src1, char* src2, int imm) {
+    char* t = new_temp(s->f);
+    append_ir(&s->first, &s->tail, new_ir(s->f, op, t, src1, src2, imm));
+    return t;
+}
+
+
+static int constant_value(ssa_info_t* info, const char* name, int* value) {
+    if (strcmp(name, "$zero") == 0) {
+        *value = 0;
+        return 1;
+    }
+    int id = ir_vreg_id(name);
+    if (id < 0 || id >= info->limit || !info->defs[id].instr || info->defs[id].instr->op != IR_LI) return 0;
+    *value = info->defs[id].instr->imm;
+    return 1;
+}
+
+
+// Digits of m, binary or canonical signed digit (each +1, 0 or -1, no two adjacent nonzero).
+// Returns the cost of the Horner chain over them: one doubling per digit below the top, one add per nonzero
+static int recode(long long m, int signed_digits, int* digits, int* top) {
+    int nonzero = 0;
+    *top = -1;
+    for (int k = 0; m; k++) {
+        int d = (int)(m & 1);
+        if (d && signed_digits) d = 2 - (int)(m & 3);  // +1 or -1, leaving an even remainder
+        m = (m - d) >> 1;
+        digits[k] = d;
+        if (d) {
+            *top = k;
+            nonzero++;
+        }
+    }
+    return *top + nonzero - 1;
+}
+
+
+// x * c as doublings and adds. Signed digits win on runs of ones: 15 = 16 - 1 costs four doublings
+// and one subtraction instead of three doublings and three additions; plain binary wins on 3 or 12
+static int emit_mul(seq_t* s, char* x, int c) {
+    if (c == 0) {
+        emit(s, IR_LI, NULL, NULL, 0);
+        return 1;
+    }
+    long long m = c < 0 ? -(long long)c : c;
+    int digits[34];
+    int csd[34];
+    int top;
+    int csd_top;
+    int cost = recode(m, 0, digits, &top);
+    int csd_cost = recode(m, 1, csd, &csd_top);
+    if (csd_cost < cost) {
+        memcpy(digits, csd, sizeof(digits));
+        top = csd_top;
+        cost = csd_cost;
+    }
+    if (cost + (c < 0) > MAX_MUL_CHAIN) return 0;
+    if (top == 0 && c > 0) {
+        emit(s, IR_MOVE, x, NULL, 0);
+        return 1;
+    }
+
+    char* acc = x;  // The top digit is always +1
+    for (int k = top - 1; k >= 0; k--) {
+        acc = emit(s, IR_ADDU, acc, acc, 0);
+        if (digits[k] > 0) acc = emit(s, IR_ADDU, acc, x, 0);
+        else if (digits[k] < 0) acc = emit(s, IR_SUBU, acc, x, 0);
+    }
+    if (c < 0) emit(s, IR_SUBU, "$zero", acc, 0);
+    return 1;
+}
+
+
+static int log2_exact(unsigned v) {
+    if (v == 0 || (v & (v - 1))) return -1;
+    int k = 0;
+    while (v >>= 1) k++;
+    return k;
+}
+
+
+// x / c for c = +-2^k, truncating toward zero like the div routine: divide |x| with srl and restore the
+// sign. m is 0 for x >= 0 and -1 otherwise, so (v ^ m) - m negates v exactly when x < 0
+static int emit_div(seq_t* s, char* x, int c, int is_unsigned) {
+    if (is_unsigned) {
+        int k = log2_exact((unsigned)c);
+        if (k < 0) return 0;
+        if (k == 0) emit(s, IR_MOVE, x, NULL, 0);
+        else emit(s, IR_SRL, x, NULL, k);
+        return 1;
+    }
+    if (c == 1) {
+        emit(s, IR_MOVE, x, NULL, 0);
+        return 1;
+    }
+    if (c == -1) {
+        emit(s, IR_SUBU, "$zero", x, 0);
+        return 1;
+    }
+    int k = log2_exact(c < 0 ? -(unsigned)c : (unsigned)c);
+    if (k < 0) return 0;  // Other divisors need a multiply-high, which the ISA lacks
+
+    char* sign = emit(s, IR_SRL, x, NULL, 31);
+    char* m = emit(s, IR_SUBU, "$zero", sign, 0);
+    char* abs = emit(s, IR_XOR, x, m, 0);
+    abs = emit(s, IR_SUBU, abs, m, 0);
+    char* q = emit(s, IR_SRL, abs, NULL, k);
+    if (c < 0) m = emit(s, IR_NOR, m, "$zero", 0);  // Negative divisor: flip the sign the other way
+    char* r = emit(s, IR_XOR, q, m, 0);
+    emit(s, IR_SUBU, r, m, 0);
+    return 1;
+}
+
+
+int strength_reduce(cfg_t* cfg) {
+    ssa_info_t* info = ssa_build_info(cfg);
+    int replaced = 0;
+    for (int k = 0; k < cfg->nblocks; k++) {
+        bb_t* b = cfg->blocks[k];
+        ir_instr_t* prev = NULL;
+        for (ir_instr_t* i = b->first; i; ) {
+            ir_instr_t* next = i->next;
+            seq_t s = { cfg->func, NULL, NULL };
+            int c;
+            int done = 0;
+            if (i->op == IR_MUL) {
+                if (constant_value(info, i->src2, &c)) done = emit_mul(&s, i->src1, c);
+                else if (constant_value(info, i->src1, &c)) done = emit_mul(&s, i->src2, c);
+            } else if ((i->op == IR_DIV || i->op == IR_DIVU) && constant_value(info, i->src2, &c) && c != 0) {
+                done = emit_div(&s, i->src1, c, i->op == IR_DIVU);
+            }
+            if (!done) {
+                prev = i;
+                i = next;
+                continue;
+            }
+            s.tail->dest = i->dest;  // The sequence's result takes over the pseudo-op's register
+            if (prev) prev->next = s.first;
+            else b->first = s.first;
+            s.tail->next = next;
+            if (b->last == i) b->last = s.tail;
+            prev = s.tail;
+            i = next;
+            replaced++;
+        }
+    }
+    ssa_free_info(info);
+    return replaced;
+}
+
+
+void expand_mul_div(ir_func_t* f) {
+    ir_instr_t* prev = NULL;
+    for (ir_instr_t* i = f->body; i; ) {
+        ir_instr_t* next = i->next;
+        if (i->op != IR_MUL && i->op != IR_DIV && i->op != IR_DIVU) {
+            prev = i;
+            i = next;
+            continue;
+        }
+        char* routine = i->op == IR_MUL ? "mult" : i->op == IR_DIV ? "div" : "divu";
+        ir_instr_t* first = NULL;
+        ir_instr_t* tail = NULL;
+        append_ir(&first, &tail, new_ir(f, IR_MOVE, "$a0", i->src1, NULL, 0));
+        append_ir(&first, &tail, new_ir(f, IR_MOVE, "$a1", i->src2, NULL, 0));
+        append_ir(&first, &tail, new_ir(f, IR_JAL, routine, NULL, NULL, 0));
+        append_ir(&first, &tail, new_ir(f, IR_MOVE, i->dest, "$v0", NULL, 0));
+        if (prev) prev->next = first;
+        else f->body = first;
+        tail->next = next;
+        prev = tail;
+        i = next;
+    }
+}
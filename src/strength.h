@@ -0,0 +1,16 @@
+#ifndef STRENGTH_H
+#define STRENGTH_H
+
+#include "cfg.h"
+
+
+// Rewrite multiplies by constants into add/subtract chains (binary or signed digits, doubling with addu)
+// and divides by powers of two into srl sequences, signed ones rounding toward zero. Works on SSA;
+// returns the number of pseudo-ops replaced
+int strength_reduce(cfg_t* cfg);
+
+
+// Turn the mul/div/divu pseudo-ops left over into calls of the mult, div and divu runtime routines
+void expand_mul_div(ir_func_t* f);
+
+#endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "unroll.h"
+
+
+#define MAX_UNROLL 4  // Copies of the body in an unrolled loop
+#define UNROLL_BUDGET 48  // Instructions those copies may add up to
+#define MAX_FULL_TRIPS 16  // Longest loop replaced by copies of its body
+#define FULL_UNROLL_BUDGET 64
+
+
+// while (iv < bound) { ...; iv = iv + step; ... }
+typedef struct {
+    loop_t* loop;
+    bb_t* header;
+    bb_t* pre;  // The one predecessor outside the loop
+    bb_t* body;  // Header successor inside the loop
+    bb_t* exit;
+    char* iv;
+    int step;
+    char* bound;  // NULL for a constant bound
+    int limit;  // The constant bound
+    int size;  // Instructions in the body
+} counted_t;
+
+
+static int loop_contains(loop_t* l, bb_t* b) {
+    for (int k = 0; k < l->nblocks; k++) {
+        if (l->blocks[k] == b) return 1;
+    }
+    return 0;
+}
+
+
+static int is_zero(const char* name) {
+    return name && strcmp(name, "$zero") == 0;
+}
+
+
+// The one instruction of the loop writing name (NULL if there are none or several)
+static ir_instr_t* only_def(loop_t* l, const char* name, bb_t** where) {
+    ir_instr_t* def = NULL;
+    for (int k = 0; k < l->nblocks; k++) {
+        for (ir_instr_t* i = l->blocks[k]->first; i; i = i->next) {
+            char** d = ir_def(i);
+            if (!d || *d != name) continue;
+            if (def) return NULL;
+            def = i;
+            *where = l->blocks[k];
+        }
+    }
+    return def;
+}
+
+
+static int match_counted(cfg_t* cfg, loop_t* l, counted_t* c) {
+    for (int k = 0; k < cfg->nloops; k++) {
+        if (cfg->loops[k]->parent == l) return 0;  // Innermost loops only
+    }
+    bb_t* h = l->header;
+    ir_instr_t* cmp = h->first;
+    if (cmp && cmp->op == IR_LABEL) cmp = cmp->next;
+    ir_instr_t* br = h->last;
+    if (!cmp || !br || cmp->next != br || h->nsuccs != 2) return 0;
+    if ((br->op != IR_BEQ && br->op != IR_BNE) || br->src1 != cmp->dest || !is_zero(br->src2)) return 0;
+    int in0 = loop_contains(l, h->succs[0]);
+    if (in0 == loop_contains(l, h->succs[1]) || in0 != (br->op == IR_BNE)) return 0;  // Must leave when cmp is 0
+
+    memset(c, 0, sizeof(*c));
+    c->loop = l;
+    c->header = h;
+    c->body = h->succs[in0 ? 0 : 1];
+    c->exit = h->succs[in0 ? 1 : 0];
+    c->iv = cmp->src1;
+    if (cmp->op == IR_SLT && ir_vreg_id(cmp->src2) >= 0) c->bound = cmp->src2;
+    else if (cmp->op == IR_SLTI) c->limit = cmp->imm;
+    else return 0;
+    if (ir_vreg_id(c->iv) < 0) return 0;
+
+    bb_t* latch = NULL;
+    for (int p = 0; p < h->npreds; p++) {
+        bb_t* pred = h->preds[p];
+        bb_t** slot = loop_contains(l, pred) ? &latch : &c->pre;
+        if (*slot) return 0;
+        *slot = pred;
+    }
+    if (!c->pre || !latch) return 0;
+
+    for (int k = 0; k < l->nblocks; k++) {
+        bb_t* b = l->blocks[k];
+        if (b == h) continue;
+        for (int s = 0; s < b->nsuccs; s++) {
+            if (!loop_contains(l, b->succs[s])) return 0;  // Only the header leaves
+        }
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            switch (i->op) {
+                case IR_JAL: case IR_JALR: case IR_SYSC: case IR_JR: case IR_MUL: case IR_DIV: case IR_DIVU:
+                    return 0;  // A call costs more than unrolling could save
+                case IR_LABEL: case IR_J: break;
+                default: c->size++;
+            }
+            char** d = ir_def(i);
+            if (d && (*d == c->bound || *d == cmp->dest)) return 0;
+        }
+    }
+
+    // iv = iv + step, or x = iv + step followed by iv = x where coalescing kept them apart
+    bb_t* step_block;
+    ir_instr_t* step = only_def(l, c->iv, &step_block);
+    if (!step || !cfg_dominates(step_block, latch)) return 0;  // Once per iteration
+    if (step->op == IR_MOVE) {
+        bb_t* add_block;
+        ir_instr_t* add = only_def(l, step->src1, &add_block);
+        if (!add || add->src1 != c->iv || !cfg_dominates(add_block, step_block)) return 0;
+        if (add_block == step_block) {
+            ir_instr_t* i = add;
+            while (i && i != step) i = i->next;
+            if (!i) return 0;  // The copy comes first
+        }
+        step = add;
+    } else if (step->src1 != c->iv) {
+        return 0;
+    }
+    if (step->op != IR_ADDI || step->imm <= 0) return 0;
+    c->step = step->imm;
+
+    for (int k = 0; k < cfg->nblocks; k++) {  // The comparison only feeds the branch
+        for (ir_instr_t* i = cfg->blocks[k]->first; i; i = i->next) {
+            char** slots[2];
+            int n = ir_uses(i, slots);
+            for (int s = 0; s < n; s++) {
+                if (*slots[s] == cmp->dest && i != br) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+// Constant value of name just before instruction `before` of b (NULL: at the end of b), following moves
+// and single-predecessor chains
+static int const_value(bb_t* b, ir_instr_t* before, const char* name, int* val, int depth) {
+    if (is_zero(name)) {
+        *val = 0;
+        return 1;
+    }
+    ir_instr_t* def = NULL;
+    for (ir_instr_t* i = b->first; i && i != before; i = i->next) {
+        char** d = ir_def(i);
+        if (d && *d == name) def = i;
+    }
+    if (depth > 8) return 0;
+    if (!def) return b->npreds == 1 && const_value(b->preds[0], NULL, name, val, depth + 1);
+    if (def->op == IR_LI) {
+        *val = def->imm;
+        return 1;
+    }
+    return def->op == IR_MOVE && const_value(b, def, def->src1, val, depth + 1);
+}
+
+
+// Copy of the loop body (every block but the header) whose back edge goes to next; returns the copy of
+// the body's entry. map: original block id -> copy
+static bb_t* clone_body(cfg_t* cfg, counted_t* c, bb_t* next, bb_t** map) {
+    loop_t* l = c->loop;
+    for (int k = 0; k < l->nblocks; k++) {
+        bb_t* b = l->blocks[k];
+        if (b == c->header) continue;
+        bb_t* nb = cfg_new_block(cfg);
+        map[b->id] = nb;
+        for (ir_instr_t* i = b->first; i; i = i->next) {
+            if (i->op == IR_LABEL) continue;
+            ir_instr_t* copy = new_ir(cfg->func, i->op, i->dest, i->src1, i->src2, i->imm);
+            copy->mem = i->mem;
+            cfg_insert_at_end(nb, copy);
+        }
+    }
+    for (int k = 0; k < l->nblocks; k++) {
+        bb_t* b = l->blocks[k];
+        if (b == c->header) continue;
+        bb_t* nb = map[b->id];
+        for (int s = 0; s < b->nsuccs; s++) cfg_add_edge(cfg, nb, b->succs[s] == c->header ? next : map[b->succs[s]->id]);
+        ir_instr_t* last = nb->last;
+        if (last && (ir_is_cond_branch(last->op) || last->op == IR_J)) last->dest = nb->succs[0]->label;
+    }
+    return map[c->body->id];
+}
+
+
+// Number of iterations when both ends are constants, -1 if unknown
+static int trip_count(counted_t* c) {
+    int init;
+    if (c->bound || !const_value(c->pre, NULL, c->iv, &init, 0)) return -1;
+    long long span = (long long)c->limit - init;
+    long long trips = span <= 0 ? 0 : (span + c->step - 1) / c->step;
+    if ((long long)init + trips * c->step > INT_MAX) return -1;  // The counter would wrap
+    return trips > MAX_FULL_TRIPS ? MAX_FULL_TRIPS + 1 : (int)trips;
+}
+
+
+// The loop's entry goes through `trips` copies of the body straight to the exit
+static void unroll_fully(cfg_t* cfg, counted_t* c, int trips, bb_t** map) {
+    bb_t* first = c->exit;
+    for (int k = 0; k < trips; k++) first = clone_body(cfg, c, first, map);
+    cfg_redirect_edge(cfg, c->pre, c->header, first);
+}
+
+
+// New loop of `copies` bodies in front of the original, which only runs the remaining iterations.
+// It continues while iv < bound - (copies - 1) * step; for a register bound, a guard skips it when
+// that subtraction wraps
+static void unroll_partially(cfg_t* cfg, counted_t* c, int copies, bb_t** map) {
+    ir_func_t* f = cfg->func;
+    int span = (copies - 1) * c->step;
+    char* lim = new_temp(f);
+    char* t = new_temp(f);
+    bb_t* head = cfg_new_block(cfg);
+    if (c->bound) {
+        bb_t* guard = cfg_new_block(cfg);
+        char* wrapped = new_temp(f);
+        cfg_insert_at_end(guard, new_ir(f, IR_ADDI, lim, c->bound, NULL, -span));
+        cfg_insert_at_end(guard, new_ir(f, IR_SLT, wrapped, c->bound, lim, 0));
+        cfg_insert_at_end(guard, new_ir(f, IR_BNE, c->header->label, wrapped, "$zero", 0));
+        cfg_add_edge(cfg, guard, c->header);
+        cfg_add_edge(cfg, guard, head);
+        cfg_redirect_edge(cfg, c->pre, c->header, guard);
+    } else {
+        cfg_insert_at_end(head, new_ir(f, IR_LI, lim, NULL, NULL, c->limit - span));
+        cfg_redirect_edge(cfg, c->pre, c->header, head);
+    }
+    cfg_insert_at_end(head, new_ir(f, IR_SLT, t, c->iv, lim, 0));
+    cfg_insert_at_end(head, new_ir(f, IR_BEQ, c->header->label, t, "$zero", 0));
+
+    bb_t* first = head;
+    for (int k = 0; k < copies; k++) first = clone_body(cfg, c, first, map);
+    cfg_add_edge(cfg, head, c->header);  // Taken: too few iterations left
+    cfg_add_edge(cfg, head, first);
+}
+
+
+int unroll_loops(cfg_t* cfg, int* full) {
+    cfg_analyze(cfg);
+    int nloops = cfg->nloops;
+    if (!nloops) return 0;
+    loop_t** loops = malloc(nloops * sizeof(loop_t*));
+    memcpy(loops, cfg->loops, nloops * sizeof(loop_t*));
+    bb_t** map = malloc(cfg->nblocks * sizeof(bb_t*));
+
+    int unrolled = 0;
+    for (int k = 0; k < nloops; k++) {
+        counted_t c;
+        if (!match_counted(cfg, loops[k], &c)) continue;
+        int trips = trip_count(&c);
+        if (trips >= 0 && trips <= MAX_FULL_TRIPS && trips * c.size <= FULL_UNROLL_BUDGET) {
+            unroll_fully(cfg, &c, trips, map);
+            (*full)++;
+            unrolled++;
+            continue;
+        }
+        int copies = MAX_UNROLL;
+        while (copies > 1 && copies * c.size > UNROLL_BUDGET) copies /= 2;
+        long long span = (long long)(copies - 1) * c.step;
+        if (copies < 2 || span > 32768 || (!c.bound && c.limit - span < INT_MIN)) continue;
+        unroll_partially(cfg, &c, copies, map);
+        unrolled++;
+    }
+    free(loops);
+    free(map);
+
+    if (unrolled) {
+        cfg_analyze(cfg);
+        cfg_remove_unreachable(cfg);
+    }
+    return unrolled;
+}
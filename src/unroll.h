@@ -0,0 +1,19 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include "cfg.h"
+
+
+// Unrolling of counted loops, run after SSA destruction so the copies can reuse the register names. An
+// innermost loop qualifies when its header only tests `iv < bound` (a register the loop never writes,
+// or a constant), the loop leaves only from there, and its body adds a positive constant to iv once
+// per iteration. Loops with calls (the runtime's multiply and divide included) are left alone.
+//
+// When the start value is a constant too, a loop with a small trip count is replaced by that many
+// copies of its body. Otherwise the body is copied 2 or 4 times, as far as the size budget allows,
+// into a new loop that runs while at least that many iterations are left; the original loop
+// follows it and runs the rest. Returns the number of loops unrolled; full counts the ones replaced
+// entirely. The caller puts the function back into SSA form to fold the copies' constants
+int unroll_loops(cfg_t* cfg, int* full);
+
+#endif